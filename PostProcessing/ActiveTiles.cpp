@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "ActiveTiles.h"
+#include "TextureHandler.h"
+
+static GLuint activityProgram, compactProgram;
+static PingPongTexture activity;
+static GLuint commandBuffer, vertexBuffer, tileVao;
+static int gridWidth, gridHeight;
+
+// Returns false if the context cannot build the tile list on the GPU (GL 4.3).
+bool createActiveTiles(int width, int height)
+{
+	if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_storage_buffer_object || !GLEW_ARB_draw_indirect)
+	{
+		std::cout << "Active tiles need compute shaders and indirect draws." << std::endl;
+		return false;
+	}
+
+	gridWidth = width;
+	gridHeight = height;
+	int tilesX = (width + ActiveTileSize - 1) / ActiveTileSize;
+	int tilesY = (height + ActiveTileSize - 1) / ActiveTileSize;
+
+	activityProgram = Shader("defaultVS.vs", "tileActivity.fs").Program;
+	compactProgram = ComputeShader("activeTiles.comp").Program;
+	activity = createPingPongTexture(tilesX, tilesY, 1);
+
+	// Two triangles per tile, as NDC positions for defaultVS.vs.
+	GLuint command[] = { 0, 1, 0, 0 };
+	glGenBuffers(1, &commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), command, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	GLint previousVao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+	glGenVertexArrays(1, &tileVao);
+	glBindVertexArray(tileVao);
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, tilesX * tilesY * 6 * 2 * sizeof(float), 0, GL_DYNAMIC_COPY);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
+	glBindVertexArray(previousVao);
+
+	return true;
+}
+
+// Rebuilds the tile list from the current velocity and density. A tile is active if it,
+// or a neighbor, moved or held density in this or the previous update, or overlaps
+// sourceRegion (x0, y0, x1, y1 in cells). The previous update is included so that both
+// buffers of each scalar slab are quiescent before a tile stops being drawn. Velocity
+// gets a force in every cell each step and is always drawn in full.
+void UpdateActiveTiles(Surface velocity, Surface density, float threshold, const int sourceRegion[4])
+{
+	GLuint p = activityProgram;
+	glUseProgram(p);
+
+	GLint tileSize = glGetUniformLocation(p, "TileSize");
+	GLint gridSize = glGetUniformLocation(p, "GridSize");
+	GLint thresholdLoc = glGetUniformLocation(p, "Threshold");
+	GLint source = glGetUniformLocation(p, "SourceRegion");
+	GLint densityScale = glGetUniformLocation(p, "DensityScale");
+	GLint dSampler = glGetUniformLocation(p, "Density");
+
+	glUniform1i(tileSize, ActiveTileSize);
+	glUniform2i(gridSize, gridWidth, gridHeight);
+	glUniform1f(thresholdLoc, threshold);
+	glUniform4i(source, sourceRegion[0], sourceRegion[1], sourceRegion[2], sourceRegion[3]);
+	glUniform1i(densityScale, density.Width / gridWidth);
+	glUniform1i(dSampler, 1);
+
+	SwapSurfaces(&activity);
+	glViewport(0, 0, activity.Ping.Width, activity.Ping.Height);
+	glBindFramebuffer(GL_FRAMEBUFFER, activity.Ping.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, density.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+	glViewport(0, 0, gridWidth, gridHeight);
+
+	// Compact the dilated map into a triangle list and its indirect draw command.
+	GLuint command[] = { 0, 1, 0, 0 };
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), command);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	p = compactProgram;
+	glUseProgram(p);
+	glUniform2i(glGetUniformLocation(p, "GridSize"), gridWidth, gridHeight);
+	glUniform1i(glGetUniformLocation(p, "TileSize"), ActiveTileSize);
+	glUniform1i(glGetUniformLocation(p, "Previous"), 1);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, activity.Ping.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, activity.Pong.TextureHandle);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, vertexBuffer);
+
+	glDispatchCompute((activity.Ping.Width + 7) / 8, (activity.Ping.Height + 7) / 8, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	ResetState();
+}
+
+// Draws the active tiles with whatever program and target are bound, in place of the full-screen quad.
+void DrawActiveTiles()
+{
+	GLint previousVao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+	glBindVertexArray(tileVao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	glDrawArraysIndirect(GL_TRIANGLES, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(previousVao);
+}
+
+// The latest activity map, which the next update dilates against; part of the state
+// a checkpoint has to carry.
+Surface ActiveTilesHistory()
+{
+	return activity.Ping;
+}
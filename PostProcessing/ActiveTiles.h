@@ -0,0 +1,11 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+#define ActiveTileSize (16)
+
+bool createActiveTiles(int width, int height);
+void UpdateActiveTiles(Surface velocity, Surface density, float threshold, const int sourceRegion[4]);
+void DrawActiveTiles();
+Surface ActiveTilesHistory();
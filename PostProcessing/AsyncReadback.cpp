@@ -0,0 +1,206 @@
+#include "stdafx.h"
+#include "AsyncReadback.h"
+
+static const GLenum ReadFormats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+
+static GLsizeiptr SlotSize(const ReadbackRing& ring)
+{
+	int bytes = (ring.Type == GL_HALF_FLOAT) ? 2 : 4;
+	return (GLsizeiptr)ring.Width * ring.Height * ring.NumComponents * bytes;
+}
+
+// type is GL_FLOAT or GL_HALF_FLOAT; half floats read back half-float fields unconverted.
+ReadbackRing createReadbackRing(int numSlots, int width, int height, int numComponents, GLenum type, ReadbackConsumer consumer, void* user)
+{
+	ReadbackRing ring;
+	ring.NumSlots = (numSlots < 1) ? 1 : (numSlots > MaxReadbackSlots) ? MaxReadbackSlots : numSlots;
+	ring.Next = 0;
+	ring.Width = width;
+	ring.Height = height;
+	ring.NumComponents = numComponents;
+	ring.Type = type;
+	ring.Consumer = consumer;
+	ring.User = user;
+	ring.Dropped = 0;
+
+	GLsizeiptr size = SlotSize(ring);
+	glGenBuffers(ring.NumSlots, ring.Buffers);
+	for (int i = 0; i < ring.NumSlots; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ring.Buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		ring.Fences[i] = 0;
+		ring.Frames[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return ring;
+}
+
+// Maps a slot whose fence has been waited on, hands it to the consumer and frees it.
+static void ConsumeSlot(ReadbackRing& ring, int slot)
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, ring.Buffers[slot]);
+	const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, SlotSize(ring), GL_MAP_READ_BIT);
+	if (data)
+	{
+		ring.Consumer(data, ring.Width, ring.Height, ring.NumComponents, ring.Frames[slot], ring.User);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glDeleteSync(ring.Fences[slot]);
+	ring.Fences[slot] = 0;
+}
+
+static bool IsSignaled(GLsync fence, GLuint64 timeout)
+{
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+// Blocks until fence is signaled. Fences signal in submission order, so after the
+// oldest slot of a ring the later ones are normally already done and return at once.
+// Should the wait fail, mapping the buffer still synchronizes with the copy.
+static void WaitForFence(GLsync fence)
+{
+	IsSignaled(fence, GL_TIMEOUT_IGNORED);
+}
+
+// Starts copying source into the next slot. If that slot still holds an unconsumed
+// readback it is consumed first. If the GPU is a whole ring behind and has not finished
+// it, nothing is waited for: the new readback is dropped and false returned.
+bool QueueReadback(ReadbackRing& ring, Surface source, int frame)
+{
+	int slot = ring.Next;
+	if (ring.Fences[slot])
+	{
+		if (!IsSignaled(ring.Fences[slot], 0))
+		{
+			ring.Dropped++;
+			return false;
+		}
+		ConsumeSlot(ring, slot);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, source.FboHandle);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, ring.Buffers[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, ring.Width, ring.Height, ReadFormats[ring.NumComponents - 1], ring.Type, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	ring.Fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.Frames[slot] = frame;
+	ring.Next = (slot + 1) % ring.NumSlots;
+	return true;
+}
+
+// Consumes, oldest first, every readback that has already completed. Never waits.
+// Returns true if anything was consumed.
+bool PollReadbacks(ReadbackRing& ring)
+{
+	bool consumed = false;
+	for (int k = 0; k < ring.NumSlots; k++)
+	{
+		int slot = (ring.Next + k) % ring.NumSlots;
+		if (!ring.Fences[slot])
+			continue;
+		if (!IsSignaled(ring.Fences[slot], 0))
+			break;
+		ConsumeSlot(ring, slot);
+		consumed = true;
+	}
+	return consumed;
+}
+
+// Waits for and consumes every outstanding readback, oldest first.
+void DrainReadbacks(ReadbackRing& ring)
+{
+	for (int k = 0; k < ring.NumSlots; k++)
+	{
+		int slot = (ring.Next + k) % ring.NumSlots;
+		if (!ring.Fences[slot])
+			continue;
+		WaitForFence(ring.Fences[slot]);
+		ConsumeSlot(ring, slot);
+	}
+}
+
+bool QueueReadbackGroup(ReadbackRing* rings, const Surface* sources, int numRings, int frame)
+{
+	for (int i = 0; i < numRings; i++)
+	{
+		GLsync fence = rings[i].Fences[rings[i].Next];
+		if (fence && !IsSignaled(fence, 0))
+		{
+			for (int j = 0; j < numRings; j++)
+			{
+				rings[j].Dropped++;
+			}
+			return false;
+		}
+	}
+
+	// Every next slot is free or finished, so none of these drops.
+	for (int i = 0; i < numRings; i++)
+	{
+		QueueReadback(rings[i], sources[i], frame);
+	}
+	return true;
+}
+
+bool PollReadbackGroup(ReadbackRing* rings, int numRings)
+{
+	bool consumed = false;
+	for (int k = 0; k < rings[0].NumSlots; k++)
+	{
+		int slot = (rings[0].Next + k) % rings[0].NumSlots;
+		if (!rings[0].Fences[slot])
+			continue;
+
+		bool ready = true;
+		for (int i = 0; i < numRings && ready; i++)
+		{
+			ready = IsSignaled(rings[i].Fences[slot], 0);
+		}
+		if (!ready)
+			break;
+
+		for (int i = 0; i < numRings; i++)
+		{
+			ConsumeSlot(rings[i], slot);
+		}
+		consumed = true;
+	}
+	return consumed;
+}
+
+void DrainReadbackGroup(ReadbackRing* rings, int numRings)
+{
+	for (int k = 0; k < rings[0].NumSlots; k++)
+	{
+		int slot = (rings[0].Next + k) % rings[0].NumSlots;
+		if (!rings[0].Fences[slot])
+			continue;
+		for (int i = 0; i < numRings; i++)
+		{
+			WaitForFence(rings[i].Fences[slot]);
+			ConsumeSlot(rings[i], slot);
+		}
+	}
+}
+
+// Frees the buffers and fences; readbacks still in flight are discarded, so drain first.
+void destroyReadbackRing(ReadbackRing& ring)
+{
+	for (int i = 0; i < ring.NumSlots; i++)
+	{
+		if (ring.Fences[i])
+			glDeleteSync(ring.Fences[i]);
+		ring.Fences[i] = 0;
+	}
+	glDeleteBuffers(ring.NumSlots, ring.Buffers);
+	ring.NumSlots = 0;
+}
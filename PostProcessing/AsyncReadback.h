@@ -0,0 +1,41 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+
+#define MaxReadbackSlots (8)
+
+// Receives a completed readback: numComponents values of the ring's Type per texel,
+// bottom row first. data is only valid for the duration of the call.
+typedef void(*ReadbackConsumer)(const void* data, int width, int height, int numComponents, int frame, void* user);
+
+// A ring of pixel pack buffers, each guarded by a fence. A surface queued into a slot
+// is handed to Consumer when the slot comes round again, NumSlots - 1 queues later,
+// by which time the copy has normally long finished and mapping does not stall. If it
+// has not, the new readback is dropped and counted in Dropped.
+typedef struct ReadbackRing_ {
+	GLuint Buffers[MaxReadbackSlots];
+	GLsync Fences[MaxReadbackSlots];
+	int Frames[MaxReadbackSlots];
+	int NumSlots;
+	int Next;
+	int Width;
+	int Height;
+	int NumComponents;
+	GLenum Type;
+	ReadbackConsumer Consumer;
+	void* User;
+	int Dropped;
+} ReadbackRing;
+
+ReadbackRing createReadbackRing(int numSlots, int width, int height, int numComponents, GLenum type, ReadbackConsumer consumer, void* user);
+bool QueueReadback(ReadbackRing& ring, Surface source, int frame);
+bool PollReadbacks(ReadbackRing& ring);
+void DrainReadbacks(ReadbackRing& ring);
+
+// Rings of equal size that are only ever queued through these hold the same frame in
+// the same slot. A frame is queued into all of them or dropped from all of them, and
+// its readbacks reach the consumers together, in ring order.
+bool QueueReadbackGroup(ReadbackRing* rings, const Surface* sources, int numRings, int frame);
+bool PollReadbackGroup(ReadbackRing* rings, int numRings);
+void DrainReadbackGroup(ReadbackRing* rings, int numRings);
+void destroyReadbackRing(ReadbackRing& ring);
@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "Checkpoint.h"
+#include "MappedFile.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A checkpoint is read back into one pixel pack buffer laid out like the file's data
+// section. Once its fence has passed the buffer is mapped and a writer thread writes
+// it out under a temporary name, renamed over the checkpoint when complete, so a crash
+// mid-write leaves the previous checkpoint intact. Only one checkpoint is in flight;
+// one requested while another is still being written is skipped.
+typedef enum CheckpointStage_ {
+	CheckpointIdle,
+	CheckpointReading,
+	CheckpointWriting
+} CheckpointStage;
+
+static CheckpointStage stage = CheckpointIdle;
+static CheckpointHeader pendingHeader;
+static std::string pendingPath;
+static GLuint packBuffer;
+static GLsizeiptr packSize;
+static GLsync packFence;
+static const uint8_t* packData;
+static std::thread writerThread;
+static std::atomic<bool> writeDone;
+static int skippedCheckpoints;
+
+static uint64_t AlignCheckpoint(uint64_t offset)
+{
+	return (offset + CheckpointAlignment - 1) / CheckpointAlignment * CheckpointAlignment;
+}
+
+// Pixel transfer format and type that copy a texture's texels without conversion.
+static bool TransferFormat(GLint internalFormat, GLenum* format, GLenum* type, int* bytesPerTexel)
+{
+	switch (internalFormat)
+	{
+	case GL_R8: *format = GL_RED; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 1; return true;
+	case GL_RG8: *format = GL_RG; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 2; return true;
+	case GL_RGB8: *format = GL_RGB; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 3; return true;
+	case GL_RGBA8: *format = GL_RGBA; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 4; return true;
+	case GL_R8UI: *format = GL_RED_INTEGER; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 1; return true;
+	case GL_RGBA8UI: *format = GL_RGBA_INTEGER; *type = GL_UNSIGNED_BYTE; *bytesPerTexel = 4; return true;
+	case GL_R16F: *format = GL_RED; *type = GL_HALF_FLOAT; *bytesPerTexel = 2; return true;
+	case GL_RG16F: *format = GL_RG; *type = GL_HALF_FLOAT; *bytesPerTexel = 4; return true;
+	case GL_RGB16F: *format = GL_RGB; *type = GL_HALF_FLOAT; *bytesPerTexel = 6; return true;
+	case GL_RGBA16F: *format = GL_RGBA; *type = GL_HALF_FLOAT; *bytesPerTexel = 8; return true;
+	case GL_R32F: *format = GL_RED; *type = GL_FLOAT; *bytesPerTexel = 4; return true;
+	case GL_RG32F: *format = GL_RG; *type = GL_FLOAT; *bytesPerTexel = 8; return true;
+	case GL_RGB32F: *format = GL_RGB; *type = GL_FLOAT; *bytesPerTexel = 12; return true;
+	case GL_RGBA32F: *format = GL_RGBA; *type = GL_FLOAT; *bytesPerTexel = 16; return true;
+	default: return false;
+	}
+}
+
+static GLint InternalFormat(Surface surface)
+{
+	GLint internalFormat = 0;
+	glBindTexture(GL_TEXTURE_2D, surface.TextureHandle);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return internalFormat;
+}
+
+static void WriteCheckpointFile()
+{
+	std::string temporary = pendingPath + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	bool ok = file != nullptr;
+	if (ok)
+	{
+		std::vector<uint8_t> head((size_t)AlignCheckpoint(sizeof(CheckpointHeader)), 0);
+		memcpy(head.data(), &pendingHeader, sizeof(CheckpointHeader));
+		ok = fwrite(head.data(), 1, head.size(), file) == head.size()
+			&& fwrite(packData, 1, (size_t)packSize, file) == (size_t)packSize;
+		ok = (fclose(file) == 0) && ok;
+	}
+	if (ok)
+	{
+		remove(pendingPath.c_str());
+		ok = rename(temporary.c_str(), pendingPath.c_str()) == 0;
+	}
+	if (!ok)
+	{
+		std::cout << "Could not write checkpoint " << pendingPath << "." << std::endl;
+	}
+	writeDone = true;
+}
+
+static void EndWrite()
+{
+	writerThread.join();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	packData = nullptr;
+	stage = CheckpointIdle;
+}
+
+// Starts reading surfaces back for a checkpoint of state to path. names identify the
+// surfaces on restore. Returns false if the checkpoint was skipped.
+bool SaveCheckpoint(const char* path, const CheckpointHeader& state, const char* const* names, const Surface* surfaces, int numSurfaces)
+{
+	PollCheckpoint();
+	if (stage != CheckpointIdle)
+	{
+		skippedCheckpoints++;
+		return false;
+	}
+	if (numSurfaces > MaxCheckpointFields)
+		return false;
+
+	CheckpointHeader header = state;
+	header.Magic = CheckpointMagic;
+	header.Version = CheckpointVersion;
+	header.NumFields = numSurfaces;
+
+	uint64_t dataStart = AlignCheckpoint(sizeof(CheckpointHeader));
+	uint64_t offset = dataStart;
+	GLenum formats[MaxCheckpointFields], types[MaxCheckpointFields];
+	for (int i = 0; i < numSurfaces; i++)
+	{
+		CheckpointField& field = header.Fields[i];
+		memset(&field, 0, sizeof(field));
+		strncpy(field.Name, names[i], sizeof(field.Name) - 1);
+		field.Width = surfaces[i].Width;
+		field.Height = surfaces[i].Height;
+		field.InternalFormat = InternalFormat(surfaces[i]);
+
+		int bytesPerTexel;
+		if (!TransferFormat(field.InternalFormat, &formats[i], &types[i], &bytesPerTexel))
+		{
+			std::cout << "Checkpoint: unsupported format for " << names[i] << "." << std::endl;
+			return false;
+		}
+		field.Offset = offset;
+		field.Size = (uint64_t)field.Width * field.Height * bytesPerTexel;
+		offset = AlignCheckpoint(offset + field.Size);
+	}
+
+	GLsizeiptr size = (GLsizeiptr)(offset - dataStart);
+	if (!packBuffer)
+	{
+		glGenBuffers(1, &packBuffer);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+	if (size != packSize)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+		packSize = size;
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (int i = 0; i < numSurfaces; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, surfaces[i].TextureHandle);
+		glGetTexImage(GL_TEXTURE_2D, 0, formats[i], types[i], (void*)(uintptr_t)(header.Fields[i].Offset - dataStart));
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	packFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pendingHeader = header;
+	pendingPath = path;
+	stage = CheckpointReading;
+	return true;
+}
+
+// Advances the checkpoint in flight without waiting: hands a completed readback to
+// the writer thread, and releases the buffer once the writer is done.
+void PollCheckpoint()
+{
+	if (stage == CheckpointReading)
+	{
+		GLenum status = glClientWaitSync(packFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+		glDeleteSync(packFence);
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+		packData = (const uint8_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, packSize, GL_MAP_READ_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (!packData)
+		{
+			stage = CheckpointIdle;
+			return;
+		}
+
+		writeDone = false;
+		writerThread = std::thread(WriteCheckpointFile);
+		stage = CheckpointWriting;
+	}
+	else if (stage == CheckpointWriting && writeDone)
+	{
+		EndWrite();
+	}
+}
+
+// Waits for the checkpoint in flight, if any, to reach the disk.
+void FinishCheckpoint()
+{
+	if (stage == CheckpointReading)
+	{
+		glClientWaitSync(packFence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		PollCheckpoint();
+	}
+	if (stage == CheckpointWriting)
+	{
+		EndWrite();
+	}
+	if (skippedCheckpoints > 0)
+	{
+		std::cout << skippedCheckpoints << " checkpoints skipped while a previous one was being written." << std::endl;
+		skippedCheckpoints = 0;
+	}
+}
+
+// Uploads the named fields of a checkpoint straight from the mapped file into surfaces,
+// which must match them in size and format, and returns the checkpoint's header.
+bool RestoreCheckpoint(const char* path, const char* const* names, const Surface* surfaces, int numSurfaces, CheckpointHeader* state)
+{
+	MappedFile file;
+	if (!MapFile(path, &file))
+	{
+		std::cout << "Could not map checkpoint " << path << "." << std::endl;
+		return false;
+	}
+
+	CheckpointHeader header;
+	bool ok = file.Size >= sizeof(header);
+	if (ok)
+	{
+		memcpy(&header, file.Data, sizeof(header));
+		ok = header.Magic == CheckpointMagic && header.Version == CheckpointVersion
+			&& header.NumFields >= 0 && header.NumFields <= MaxCheckpointFields;
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; ok && i < numSurfaces; i++)
+	{
+		const CheckpointField* field = nullptr;
+		for (int j = 0; j < header.NumFields; j++)
+		{
+			if (strncmp(header.Fields[j].Name, names[i], sizeof(header.Fields[j].Name)) == 0)
+				field = &header.Fields[j];
+		}
+
+		GLenum format, type;
+		int bytesPerTexel;
+		ok = field && field->Width == surfaces[i].Width && field->Height == surfaces[i].Height
+			&& (GLint)field->InternalFormat == InternalFormat(surfaces[i])
+			&& TransferFormat(field->InternalFormat, &format, &type, &bytesPerTexel)
+			&& field->Offset + field->Size <= file.Size;
+		if (!ok)
+		{
+			std::cout << "Checkpoint " << path << " has no matching " << names[i] << "." << std::endl;
+			break;
+		}
+
+		glBindTexture(GL_TEXTURE_2D, surfaces[i].TextureHandle);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, field->Width, field->Height, format, type, file.Data + field->Offset);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	UnmapFile(&file);
+
+	if (ok && state)
+		*state = header;
+	return ok;
+}
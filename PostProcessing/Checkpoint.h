@@ -0,0 +1,51 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+
+#include <cstdint>
+
+// Checkpoint files: a CheckpointHeader, then each field's texels exactly as the texture
+// stores them, starting on a CheckpointAlignment boundary so that a mapped file can be
+// handed to glTexSubImage2D without copying or converting. All values are little-endian.
+#define CheckpointMagic (0x504B4346u) // "FCKP"
+#define CheckpointVersion (2)
+#define CheckpointAlignment (4096)
+#define MaxCheckpointFields (16)
+
+typedef struct CheckpointField_ {
+	char Name[16];
+	int32_t Width;
+	int32_t Height;
+	uint32_t InternalFormat;
+	uint32_t Reserved;
+	uint64_t Offset;
+	uint64_t Size;
+} CheckpointField;
+
+// The caller fills in everything but the magic, version and field table. Solver,
+// Advection, CycleType and WarmStart hold the enums, Options a caller-defined set of
+// flags, and IterationCount the adaptive iteration count of the active solver.
+typedef struct CheckpointHeader_ {
+	uint32_t Magic;
+	uint32_t Version;
+	int32_t GridWidth;
+	int32_t GridHeight;
+	int32_t DensityScale;
+	int32_t NumScalarFields;
+	int32_t Step;
+	float MaxSpeed;
+	int32_t Solver;
+	int32_t Advection;
+	int32_t CycleType;
+	int32_t WarmStart;
+	int32_t IterationCount;
+	uint32_t Options;
+	int32_t NumFields;
+	uint32_t Reserved;
+	CheckpointField Fields[MaxCheckpointFields];
+} CheckpointHeader;
+
+bool SaveCheckpoint(const char* path, const CheckpointHeader& state, const char* const* names, const Surface* surfaces, int numSurfaces);
+void PollCheckpoint();
+void FinishCheckpoint();
+bool RestoreCheckpoint(const char* path, const char* const* names, const Surface* surfaces, int numSurfaces, CheckpointHeader* state);
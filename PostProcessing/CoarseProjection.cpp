@@ -0,0 +1,84 @@
+#include "stdafx.h"
+#include "CoarseProjection.h"
+#include "TextureHandler.h"
+#include "Obstacle.h"
+
+static GLuint restrictVelocityProgram, restrictObstaclesProgram, subtractGradientProgram;
+static Surface coarseVelocity, coarseDivergence, coarseObstacles, coarseMask;
+static PingPongTexture coarsePressure;
+
+static void SetViewport(Surface s)
+{
+	glViewport(0, 0, s.Width, s.Height);
+}
+
+static void Restrict(GLuint program, Surface source, Surface dest)
+{
+	glUseProgram(program);
+	glUniform2i(glGetUniformLocation(program, "SourceSize"), source.Width, source.Height);
+
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+}
+
+// The coarse grid is half the simulation grid; a coarse cell is solid if any of its children is.
+void createCoarseProjection(Surface obstacles, int width, int height)
+{
+	restrictVelocityProgram = Shader("defaultVS.vs", "restrictVelocity.fs").Program;
+	restrictObstaclesProgram = Shader("defaultVS.vs", "restrictObstacles.fs").Program;
+	subtractGradientProgram = Shader("defaultVS.vs", "subtractGradientUpsampled.fs").Program;
+
+	int w = (width + 1) / 2;
+	int h = (height + 1) / 2;
+	coarseVelocity = createSurface(w, h, 2);
+	coarseDivergence = createSurface(w, h, 1);
+	coarsePressure = createPingPongTexture(w, h, 1);
+	coarseObstacles = createSurface(w, h, 1);
+	coarseMask = createMaskSurface(w, h);
+
+	Restrict(restrictObstaclesProgram, obstacles, coarseObstacles);
+	createObstacleMask(coarseObstacles, coarseMask);
+	glViewport(0, 0, width, height);
+}
+
+// Projects velocity into dest with the pressure solved on the coarse grid. Velocity is
+// averaged down, its divergence relaxed with numIterations Jacobi sweeps at twice the
+// cell size, and the bilinearly upsampled pressure gradient is subtracted from the
+// full-resolution velocity. The coarse pressure warm-starts the next call.
+void CoarseProject(Shader& computeDivergence, Shader& jacobi, Surface velocity, Surface obstacleMask, Surface dest, float cellSize, int numIterations)
+{
+	Restrict(restrictVelocityProgram, velocity, coarseVelocity);
+	ComputeDivergence(computeDivergence, coarseVelocity, coarseMask, coarseDivergence, 2.0f * cellSize);
+
+	for (int i = 0; i < numIterations; i++)
+	{
+		Jacobi(jacobi, coarsePressure.Ping, coarseDivergence, coarseMask, coarsePressure.Pong, 2.0f * cellSize, 1.0f);
+		SwapSurfaces(&coarsePressure);
+	}
+
+	GLuint p = subtractGradientProgram;
+	glUseProgram(p);
+
+	GLint inverseSize = glGetUniformLocation(p, "InverseSize");
+	GLint gradientScale = glGetUniformLocation(p, "GradientScale");
+	glUniform2f(inverseSize, 1.0f / dest.Width, 1.0f / dest.Height);
+	glUniform1f(gradientScale, 1.125f / cellSize);
+	glUniform1i(glGetUniformLocation(p, "Pressure"), 1);
+	glUniform1i(glGetUniformLocation(p, "ObstacleMask"), 2);
+
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, coarsePressure.Ping.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	ResetState();
+}
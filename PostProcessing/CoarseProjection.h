@@ -0,0 +1,7 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+void createCoarseProjection(Surface obstacles, int width, int height);
+void CoarseProject(Shader& computeDivergence, Shader& jacobi, Surface velocity, Surface obstacleMask, Surface dest, float cellSize, int numIterations);
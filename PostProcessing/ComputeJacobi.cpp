@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "ComputeJacobi.h"
+
+#define TileSize (32)
+
+static GLuint jacobiTiledProgram;
+
+// Returns false if the context has no compute shaders (GL 4.3).
+bool createComputeJacobi()
+{
+	if (!GLEW_ARB_compute_shader || !GLEW_ARB_shader_image_load_store)
+	{
+		std::cout << "Compute shaders not supported." << std::endl;
+		return false;
+	}
+
+	jacobiTiledProgram = ComputeShader("jacobiTiled.comp").Program;
+	return true;
+}
+
+// Runs up to MaxIterationsPerDispatch Jacobi sweeps from pressure into dest in a single dispatch.
+void ComputeJacobi(Surface pressure, Surface divergence, Surface obstacles, Surface dest, float cellSize, float omega, int iterations)
+{
+	if (iterations > MaxIterationsPerDispatch) iterations = MaxIterationsPerDispatch;
+
+	GLuint p = jacobiTiledProgram;
+	glUseProgram(p);
+
+	GLint alpha = glGetUniformLocation(p, "Alpha");
+	GLint inverseBeta = glGetUniformLocation(p, "InverseBeta");
+	GLint omegaLoc = glGetUniformLocation(p, "Omega");
+	GLint iterationsLoc = glGetUniformLocation(p, "Iterations");
+	GLint gridSize = glGetUniformLocation(p, "GridSize");
+	GLint dSampler = glGetUniformLocation(p, "Divergence");
+	GLint oSampler = glGetUniformLocation(p, "Obstacles");
+
+	glUniform1f(alpha, -cellSize * cellSize);
+	glUniform1f(inverseBeta, 0.25f);
+	glUniform1f(omegaLoc, omega);
+	glUniform1i(iterationsLoc, iterations);
+	glUniform2i(gridSize, dest.Width, dest.Height);
+	glUniform1i(dSampler, 1);
+	glUniform1i(oSampler, 2);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, divergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	glBindImageTexture(0, dest.TextureHandle, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+
+	int tile = TileSize - 2 * iterations;
+	glDispatchCompute((dest.Width + tile - 1) / tile, (dest.Height + tile - 1) / tile, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R16F);
+	ResetState();
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+// Widest halo of the 32-texel tiles of jacobiTiled.comp: K sweeps per dispatch write
+// back the inner 32 - 2K texels, a quarter of the tile at K = 8.
+#define MaxIterationsPerDispatch (8)
+
+bool createComputeJacobi();
+void ComputeJacobi(Surface pressure, Surface divergence, Surface obstacles, Surface dest, float cellSize, float omega, int iterations);
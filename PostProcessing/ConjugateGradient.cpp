@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "ConjugateGradient.h"
+#include "Reduction.h"
+#include "TextureHandler.h"
+
+// How often the solver polls the asynchronously read back residual.
+#define ConvergenceCheckInterval (4)
+
+static PingPongTexture x, r, p, rz;
+static Surface Ap, inverseDiagonal, pAp, rzInitial;
+static ReductionChain chain;
+static float cgCellSize;
+static GLuint applyOperatorProgram, dotProgram, axpyProgram, updateDirectionProgram;
+static GLuint convergencePbo;
+
+static void BindSampler(GLuint p, const char* name, int unit, Surface s)
+{
+	glUniform1i(glGetUniformLocation(p, name), unit);
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, s.TextureHandle);
+}
+
+static void Draw(Surface dest)
+{
+	glViewport(0, 0, dest.Width, dest.Height);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+}
+
+static void ApplyOperator(Surface direction, Surface divergence, Surface obstacleMask, Surface dest, bool initialize)
+{
+	GLuint prog = applyOperatorProgram;
+	glUseProgram(prog);
+
+	glUniform1f(glGetUniformLocation(prog, "InverseCellSizeSquared"), 1.0f / (cgCellSize * cgCellSize));
+	glUniform1i(glGetUniformLocation(prog, "Initialize"), initialize ? 1 : 0);
+	BindSampler(prog, "Direction", 0, direction);
+	BindSampler(prog, "ObstacleMask", 1, obstacleMask);
+	BindSampler(prog, "Divergence", 2, divergence);
+	Draw(dest);
+}
+
+static void Dot(Surface a, Surface b, bool precondition, Surface dest)
+{
+	GLuint prog = dotProgram;
+	glUseProgram(prog);
+
+	glUniform2i(glGetUniformLocation(prog, "SourceSize"), a.Width, a.Height);
+	glUniform1i(glGetUniformLocation(prog, "Precondition"), precondition ? 1 : 0);
+	BindSampler(prog, "A", 0, a);
+	BindSampler(prog, "B", 1, b);
+	BindSampler(prog, "InverseDiagonal", 2, inverseDiagonal);
+	Draw(chain.Levels[0]);
+
+	Reduce(chain, ReductionSum, dest);
+}
+
+static void Axpy(Surface source, Surface direction, float sign, float tolerance, Surface dest)
+{
+	GLuint prog = axpyProgram;
+	glUseProgram(prog);
+
+	glUniform1f(glGetUniformLocation(prog, "Sign"), sign);
+	glUniform1f(glGetUniformLocation(prog, "ToleranceSquared"), tolerance * tolerance);
+	BindSampler(prog, "X", 0, source);
+	BindSampler(prog, "P", 1, direction);
+	BindSampler(prog, "Numerator", 2, rz.Ping);
+	BindSampler(prog, "Denominator", 3, pAp);
+	BindSampler(prog, "InitialNorm", 4, rzInitial);
+	Draw(dest);
+}
+
+static void UpdateDirection(bool restart)
+{
+	GLuint prog = updateDirectionProgram;
+	glUseProgram(prog);
+
+	glUniform1i(glGetUniformLocation(prog, "Restart"), restart ? 1 : 0);
+	BindSampler(prog, "Residual", 0, r.Ping);
+	BindSampler(prog, "Direction", 1, p.Ping);
+	BindSampler(prog, "InverseDiagonal", 2, inverseDiagonal);
+	BindSampler(prog, "RzNew", 3, rz.Pong);
+	BindSampler(prog, "RzOld", 4, rz.Ping);
+	Draw(p.Pong);
+	SwapSurfaces(&p);
+}
+
+// Queues a non-blocking readback of the current and initial r.z into the PBO.
+static GLsync RequestConvergence()
+{
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, convergencePbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, rz.Ping.FboHandle);
+	glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, (void*)0);
+	glBindFramebuffer(GL_FRAMEBUFFER, rzInitial.FboHandle);
+	glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, (void*)sizeof(float));
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Returns 1 if converged, 0 if not, -1 if the readback is still in flight.
+static int PollConvergence(GLsync fence, float tolerance)
+{
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return -1;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, convergencePbo);
+	float* norms = (float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 2 * sizeof(float), GL_MAP_READ_BIT);
+	int converged = norms[0] <= tolerance * tolerance * norms[1];
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	return converged;
+}
+
+void createConjugateGradient(Surface obstacleMask, int width, int height, float cellSize)
+{
+	applyOperatorProgram = Shader("defaultVS.vs", "cgApplyOperator.fs").Program;
+	dotProgram = Shader("defaultVS.vs", "cgDot.fs").Program;
+	axpyProgram = Shader("defaultVS.vs", "cgAxpy.fs").Program;
+	updateDirectionProgram = Shader("defaultVS.vs", "cgUpdateDirection.fs").Program;
+	cgCellSize = cellSize;
+
+	// Krylov vectors and scalars need full floats; half precision stalls convergence.
+	x = createPingPongTexture(width, height, 1, false);
+	r = createPingPongTexture(width, height, 1, false);
+	p = createPingPongTexture(width, height, 1, false);
+	Ap = createSurface(width, height, 1, false);
+	inverseDiagonal = createSurface(width, height, 1, false);
+	rz = createPingPongTexture(1, 1, 1, false);
+	pAp = createSurface(1, 1, 1, false);
+	rzInitial = createSurface(1, 1, 1, false);
+	chain = createReductionChain(width, height);
+
+	glGenBuffers(1, &convergencePbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, convergencePbo);
+	glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(float), 0, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// The obstacles are static, so the preconditioner is built once.
+	Shader makeDiagonal("defaultVS.vs", "cgInverseDiagonal.fs");
+	makeDiagonal.Use();
+	glUniform1f(glGetUniformLocation(makeDiagonal.Program, "CellSizeSquared"), cellSize * cellSize);
+	BindSampler(makeDiagonal.Program, "ObstacleMask", 0, obstacleMask);
+	Draw(inverseDiagonal);
+	glDeleteProgram(makeDiagonal.Program);
+
+	glViewport(0, 0, width, height);
+}
+
+// Warm-starts from the current pressure and returns the number of iterations issued.
+int ConjugateGradientSolve(Surface pressure, Surface divergence, Surface obstacleMask, float tolerance, int maxIterations)
+{
+	CopySurface(pressure, x.Ping);
+
+	ApplyOperator(x.Ping, divergence, obstacleMask, r.Ping, true);
+	UpdateDirection(true);
+	Dot(r.Ping, r.Ping, true, rz.Ping);
+	CopySurface(rz.Ping, rzInitial);
+
+	GLsync fence = 0;
+	int i = 0;
+	while (i < maxIterations)
+	{
+		ApplyOperator(p.Ping, divergence, obstacleMask, Ap, false);
+		Dot(p.Ping, Ap, false, pAp);
+
+		Axpy(x.Ping, p.Ping, 1.0f, tolerance, x.Pong);
+		Axpy(r.Ping, Ap, -1.0f, tolerance, r.Pong);
+		SwapSurfaces(&x);
+		SwapSurfaces(&r);
+
+		Dot(r.Ping, r.Ping, true, rz.Pong);
+		UpdateDirection(false);
+		SwapSurfaces(&rz);
+		i++;
+
+		if (i % ConvergenceCheckInterval == 0)
+		{
+			int converged = fence ? PollConvergence(fence, tolerance) : 0;
+			if (converged == 1)
+				break;
+			if (converged == 0)
+			{
+				if (fence) glDeleteSync(fence);
+				fence = RequestConvergence();
+			}
+		}
+	}
+
+	if (fence) glDeleteSync(fence);
+
+	CopySurface(x.Ping, pressure);
+	glViewport(0, 0, pressure.Width, pressure.Height);
+	return i;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+void createConjugateGradient(Surface obstacleMask, int width, int height, float cellSize);
+int ConjugateGradientSolve(Surface pressure, Surface divergence, Surface obstacleMask, float tolerance, int maxIterations);
@@ -0,0 +1,326 @@
+#include "stdafx.h"
+#include "FieldSequence.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Codec: each half float is replaced by its difference from the texel to the left (the
+// texel below at the start of a row), per component and zigzag coded so that small
+// differences of either sign have a zero high byte. The low and high bytes are then
+// split into two planes and the planes run-length coded with PackBits: a control byte
+// c < 128 is followed by c + 1 literal bytes, c >= 128 by one byte repeated c - 126 times.
+
+static void PackBits(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+	size_t i = 0;
+	while (i < size)
+	{
+		size_t run = 1;
+		while (i + run < size && run < 129 && data[i + run] == data[i])
+			run++;
+
+		if (run >= 3)
+		{
+			out.push_back((uint8_t)(run + 126));
+			out.push_back(data[i]);
+			i += run;
+			continue;
+		}
+
+		size_t start = i;
+		size_t literals = 0;
+		while (i < size && literals < 128)
+		{
+			if (i + 2 < size && data[i] == data[i + 1] && data[i] == data[i + 2])
+				break;
+			i++;
+			literals++;
+		}
+		out.push_back((uint8_t)(literals - 1));
+		out.insert(out.end(), data + start, data + start + literals);
+	}
+}
+
+static bool UnpackBits(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+{
+	size_t i = 0, o = 0;
+	while (i < size && o < outSize)
+	{
+		uint8_t c = data[i++];
+		if (c < 128)
+		{
+			size_t n = (size_t)c + 1;
+			if (i + n > size || o + n > outSize)
+				return false;
+			memcpy(out + o, data + i, n);
+			i += n;
+			o += n;
+		}
+		else
+		{
+			size_t n = (size_t)c - 126;
+			if (i >= size || o + n > outSize)
+				return false;
+			memset(out + o, data[i++], n);
+			o += n;
+		}
+	}
+	return o == outSize;
+}
+
+void EncodeHalfField(const uint16_t* texels, int width, int height, int numComponents, std::vector<uint8_t>& out)
+{
+	size_t count = (size_t)width * height * numComponents;
+	std::vector<uint8_t> planes(2 * count);
+	size_t rowLength = (size_t)width * numComponents;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t predictor = (i % rowLength >= (size_t)numComponents) ? i - numComponents : (i >= rowLength ? i - rowLength : count);
+		uint16_t previous = (predictor < count) ? texels[predictor] : 0;
+		int16_t delta = (int16_t)(texels[i] - previous);
+		uint16_t zigzag = (uint16_t)((delta << 1) ^ (delta >> 15));
+		planes[i] = (uint8_t)(zigzag & 0xFF);
+		planes[count + i] = (uint8_t)(zigzag >> 8);
+	}
+
+	out.clear();
+	PackBits(planes.data(), planes.size(), out);
+}
+
+// Returns false if data does not decode to exactly width * height * numComponents texels.
+bool DecodeHalfField(const uint8_t* data, size_t size, int width, int height, int numComponents, uint16_t* texels)
+{
+	size_t count = (size_t)width * height * numComponents;
+	std::vector<uint8_t> planes(2 * count);
+	if (!UnpackBits(data, size, planes.data(), planes.size()))
+		return false;
+
+	size_t rowLength = (size_t)width * numComponents;
+	for (size_t i = 0; i < count; i++)
+	{
+		uint16_t zigzag = (uint16_t)(planes[i] | (planes[count + i] << 8));
+		uint16_t delta = (uint16_t)((zigzag >> 1) ^ (uint16_t)(0 - (zigzag & 1)));
+		size_t predictor = (i % rowLength >= (size_t)numComponents) ? i - numComponents : (i >= rowLength ? i - rowLength : count);
+		uint16_t previous = (predictor < count) ? texels[predictor] : 0;
+		texels[i] = (uint16_t)(previous + delta);
+	}
+	return true;
+}
+
+// Chunk offsets outgrow a 32-bit long on long runs.
+static int Seek(FILE* file, int64_t offset, int origin)
+{
+#ifdef _MSC_VER
+	return _fseeki64(file, offset, origin);
+#else
+	return fseeko(file, offset, origin);
+#endif
+}
+
+// Writer: update() hands the raw fields of a frame, in field order, to a ring of
+// SequenceQueueSlots preallocated frame slots. A slot is published to the writer thread,
+// which compresses and writes it, once all NumFields fields are in. When the ring is full
+// the whole frame is dropped rather than waited for, so a frame is recorded with every
+// field or not at all.
+typedef struct SequenceJob_ {
+	int Frame;
+	std::vector<uint16_t> Texels[MaxSequenceFields];
+} SequenceJob;
+
+static FILE* sequenceFile;
+static SequenceHeader sequenceHeader;
+static SequenceJob jobs[SequenceQueueSlots];
+static unsigned jobsHead, jobsTail;
+static bool closing;
+static std::mutex jobsMutex;
+static std::condition_variable jobsReady, slotFree;
+static std::thread writerThread;
+static std::vector<SequenceIndexEntry> sequenceIndex;
+static uint64_t sequenceOffset, rawBytes;
+static int droppedFrames;
+
+// Frame being filled by QueueSequenceField in slot jobsHead, not yet visible to the writer.
+static int stagingFrame;
+static int stagingFields;
+static bool stagingDropped;
+
+static void WriterLoop()
+{
+	std::vector<uint8_t> compressed;
+	std::unique_lock<std::mutex> lock(jobsMutex);
+	for (;;)
+	{
+		jobsReady.wait(lock, [] { return jobsHead != jobsTail || closing; });
+		if (jobsHead == jobsTail)
+			break;
+
+		SequenceJob& job = jobs[jobsTail % SequenceQueueSlots];
+		lock.unlock();
+		for (int i = 0; i < sequenceHeader.NumFields; i++)
+		{
+			SequenceField& field = sequenceHeader.Fields[i];
+			EncodeHalfField(job.Texels[i].data(), field.Width, field.Height, field.NumComponents, compressed);
+
+			SequenceIndexEntry entry = { sequenceOffset, (uint32_t)compressed.size(), job.Frame, i, 0 };
+			if (fwrite(compressed.data(), 1, compressed.size(), sequenceFile) != compressed.size())
+			{
+				std::cout << "Field sequence write failed." << std::endl;
+			}
+			sequenceIndex.push_back(entry);
+			sequenceOffset += compressed.size();
+			rawBytes += job.Texels[i].size() * sizeof(uint16_t);
+		}
+		lock.lock();
+		jobsTail++;
+		slotFree.notify_one();
+	}
+}
+
+bool openSequenceWriter(const char* path, const SequenceHeader& header)
+{
+	sequenceFile = fopen(path, "wb");
+	if (!sequenceFile)
+	{
+		std::cout << "Could not open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	sequenceHeader = header;
+	sequenceHeader.Magic = SequenceMagic;
+	sequenceHeader.Version = SequenceVersion;
+	fwrite(&sequenceHeader, sizeof(sequenceHeader), 1, sequenceFile);
+	sequenceOffset = sizeof(sequenceHeader);
+	rawBytes = 0;
+	droppedFrames = 0;
+	sequenceIndex.clear();
+
+	for (int i = 0; i < SequenceQueueSlots; i++)
+	{
+		for (int f = 0; f < header.NumFields; f++)
+		{
+			jobs[i].Texels[f].resize((size_t)header.Fields[f].Width * header.Fields[f].Height * header.Fields[f].NumComponents);
+		}
+	}
+
+	jobsHead = 0;
+	jobsTail = 0;
+	closing = false;
+	stagingFrame = -1;
+	stagingFields = 0;
+	stagingDropped = false;
+	writerThread = std::thread(WriterLoop);
+	return true;
+}
+
+// Copies the texels of one field into the frame being staged. Field 0 starts a frame:
+// it claims a slot, or, with the writer a full ring behind and wait unset, drops the
+// frame. The last field publishes it. Returns false if the field was not recorded.
+bool QueueSequenceField(int field, int frame, const uint16_t* texels, bool wait)
+{
+	if (field == 0)
+	{
+		if (stagingFrame >= 0 && !stagingDropped)
+		{
+			droppedFrames++;
+		}
+		stagingFrame = frame;
+		stagingFields = 0;
+
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		if (wait)
+		{
+			slotFree.wait(lock, [] { return jobsHead - jobsTail < SequenceQueueSlots; });
+		}
+		stagingDropped = jobsHead - jobsTail >= SequenceQueueSlots;
+		if (stagingDropped)
+		{
+			droppedFrames++;
+		}
+	}
+	if (frame != stagingFrame || stagingDropped)
+		return false;
+
+	SequenceJob& job = jobs[jobsHead % SequenceQueueSlots];
+	job.Frame = frame;
+	std::copy(texels, texels + job.Texels[field].size(), job.Texels[field].begin());
+	stagingFields |= 1 << field;
+
+	if (stagingFields == (1 << sequenceHeader.NumFields) - 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			jobsHead++;
+		}
+		jobsReady.notify_one();
+		stagingFrame = -1;
+	}
+	return true;
+}
+
+// Waits for the writer to empty the queue, then appends the index and footer.
+void closeSequenceWriter()
+{
+	if (!sequenceFile)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		closing = true;
+	}
+	jobsReady.notify_one();
+	writerThread.join();
+
+	SequenceFooter footer = { sequenceOffset, (uint32_t)sequenceIndex.size(), SequenceIndexMagic };
+	fwrite(sequenceIndex.data(), sizeof(SequenceIndexEntry), sequenceIndex.size(), sequenceFile);
+	fwrite(&footer, sizeof(footer), 1, sequenceFile);
+	fclose(sequenceFile);
+	sequenceFile = nullptr;
+
+	std::cout << "Field sequence: " << sequenceIndex.size() << " chunks, "
+		<< rawBytes / (1024.0f * 1024.0f) << " MB raw, " << (sequenceOffset - sizeof(SequenceHeader)) / (1024.0f * 1024.0f)
+		<< " MB compressed, " << droppedFrames << " frames dropped" << std::endl;
+}
+
+// Reads one field of one frame through the index, without touching any other chunk.
+bool ReadSequenceField(const char* path, int frame, int field, std::vector<uint16_t>& texels, SequenceHeader* header)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	SequenceHeader h;
+	SequenceFooter footer;
+	bool ok = fread(&h, sizeof(h), 1, file) == 1 && h.Magic == SequenceMagic && h.Version == SequenceVersion
+		&& field >= 0 && field < h.NumFields
+		&& Seek(file, -(int64_t)sizeof(footer), SEEK_END) == 0 && fread(&footer, sizeof(footer), 1, file) == 1
+		&& footer.Magic == SequenceIndexMagic;
+
+	std::vector<SequenceIndexEntry> index(ok ? footer.NumEntries : 0);
+	ok = ok && Seek(file, (int64_t)footer.IndexOffset, SEEK_SET) == 0
+		&& fread(index.data(), sizeof(SequenceIndexEntry), index.size(), file) == index.size();
+
+	const SequenceIndexEntry* entry = nullptr;
+	for (size_t i = 0; ok && i < index.size(); i++)
+	{
+		if (index[i].Frame == frame && index[i].Field == field)
+			entry = &index[i];
+	}
+
+	std::vector<uint8_t> compressed(entry ? entry->Size : 0);
+	ok = ok && entry && Seek(file, (int64_t)entry->Offset, SEEK_SET) == 0
+		&& fread(compressed.data(), 1, compressed.size(), file) == compressed.size();
+	fclose(file);
+	if (!ok)
+		return false;
+
+	SequenceField& f = h.Fields[field];
+	texels.resize((size_t)f.Width * f.Height * f.NumComponents);
+	if (header)
+		*header = h;
+	return DecodeHalfField(compressed.data(), compressed.size(), f.Width, f.Height, f.NumComponents, texels.data());
+}
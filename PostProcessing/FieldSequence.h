@@ -0,0 +1,55 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+
+#include <cstdint>
+#include <vector>
+
+// Field sequence files: a fixed SequenceHeader, then one compressed chunk per recorded
+// field and frame, then an index of every chunk and a SequenceFooter at the very end.
+// Texels are stored as half floats. All values are little-endian.
+#define SequenceMagic (0x51455346u) // "FSEQ"
+#define SequenceIndexMagic (0x58444946u) // "FIDX"
+#define SequenceVersion (1)
+#define MaxSequenceFields (4)
+#define SequenceQueueSlots (8)
+
+typedef struct SequenceField_ {
+	char Name[16];
+	int32_t Width;
+	int32_t Height;
+	int32_t NumComponents;
+} SequenceField;
+
+typedef struct SequenceHeader_ {
+	uint32_t Magic;
+	uint32_t Version;
+	int32_t GridWidth;
+	int32_t GridHeight;
+	float FrameTime;
+	int32_t NumFields;
+	SequenceField Fields[MaxSequenceFields];
+} SequenceHeader;
+
+typedef struct SequenceIndexEntry_ {
+	uint64_t Offset;
+	uint32_t Size;
+	int32_t Frame;
+	int32_t Field;
+	uint32_t Reserved;
+} SequenceIndexEntry;
+
+typedef struct SequenceFooter_ {
+	uint64_t IndexOffset;
+	uint32_t NumEntries;
+	uint32_t Magic;
+} SequenceFooter;
+
+void EncodeHalfField(const uint16_t* texels, int width, int height, int numComponents, std::vector<uint8_t>& out);
+bool DecodeHalfField(const uint8_t* data, size_t size, int width, int height, int numComponents, uint16_t* texels);
+
+bool openSequenceWriter(const char* path, const SequenceHeader& header);
+bool QueueSequenceField(int field, int frame, const uint16_t* texels, bool wait);
+void closeSequenceWriter();
+
+bool ReadSequenceField(const char* path, int frame, int field, std::vector<uint16_t>& texels, SequenceHeader* header);
@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "FieldWriter.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define MaxFieldWriterSlots (8)
+
+// Portable float map: "Pf" for one channel, "PF" for three; two channels are written
+// as three with a zero blue. Rows are stored bottom first, as OpenGL reads them, and a
+// negative scale marks little-endian data.
+bool WriteFieldPfm(const char* path, const float* data, int width, int height, int numComponents)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		std::cout << "Could not open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	int channels = (numComponents == 1) ? 1 : 3;
+	fprintf(file, "%s\n%d %d\n-1.0\n", (channels == 1) ? "Pf" : "PF", width, height);
+
+	std::vector<float> row((size_t)width * channels, 0.0f);
+	bool ok = true;
+	for (int y = 0; y < height && ok; y++)
+	{
+		const float* source = data + (size_t)y * width * numComponents;
+		for (int x = 0; x < width; x++)
+		{
+			for (int c = 0; c < channels && c < numComponents; c++)
+			{
+				row[x * channels + c] = source[x * numComponents + c];
+			}
+		}
+		ok = fwrite(row.data(), sizeof(float), row.size(), file) == row.size();
+	}
+
+	fclose(file);
+	if (!ok)
+	{
+		std::cout << "Could not write " << path << "." << std::endl;
+	}
+	return ok;
+}
+
+typedef struct FieldJob_ {
+	char Path[1024];
+	std::vector<float> Data;
+} FieldJob;
+
+static FieldJob jobs[MaxFieldWriterSlots];
+static int numJobSlots, jobWidth, jobHeight, jobComponents;
+static unsigned jobsHead, jobsTail;
+static bool closing;
+static std::mutex jobsMutex;
+static std::condition_variable jobsReady, slotFree;
+static std::thread writerThread;
+static int droppedFields;
+
+// Slots between jobsTail and jobsHead belong to the writer; the rest to QueueFieldPfm.
+static void WriterLoop()
+{
+	std::unique_lock<std::mutex> lock(jobsMutex);
+	for (;;)
+	{
+		jobsReady.wait(lock, [] { return jobsHead != jobsTail || closing; });
+		if (jobsHead == jobsTail)
+			break;
+
+		FieldJob& job = jobs[jobsTail % numJobSlots];
+		lock.unlock();
+		WriteFieldPfm(job.Path, job.Data.data(), jobWidth, jobHeight, jobComponents);
+		lock.lock();
+		jobsTail++;
+		slotFree.notify_one();
+	}
+}
+
+bool startFieldWriter(int numSlots, int width, int height, int numComponents)
+{
+	numJobSlots = (numSlots < 1) ? 1 : (numSlots > MaxFieldWriterSlots) ? MaxFieldWriterSlots : numSlots;
+	jobWidth = width;
+	jobHeight = height;
+	jobComponents = numComponents;
+	for (int i = 0; i < numJobSlots; i++)
+	{
+		jobs[i].Data.resize((size_t)width * height * numComponents);
+	}
+
+	jobsHead = 0;
+	jobsTail = 0;
+	closing = false;
+	droppedFields = 0;
+	writerThread = std::thread(WriterLoop);
+	return true;
+}
+
+bool QueueFieldPfm(const char* path, const float* data, bool wait)
+{
+	unsigned head;
+	{
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		if (wait)
+		{
+			slotFree.wait(lock, [] { return jobsHead - jobsTail < (unsigned)numJobSlots; });
+		}
+		else if (jobsHead - jobsTail >= (unsigned)numJobSlots)
+		{
+			droppedFields++;
+			return false;
+		}
+		head = jobsHead;
+	}
+
+	FieldJob& job = jobs[head % numJobSlots];
+	snprintf(job.Path, sizeof(job.Path), "%s", path);
+	std::copy(data, data + job.Data.size(), job.Data.begin());
+
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobsHead++;
+	}
+	jobsReady.notify_one();
+	return true;
+}
+
+// Writes every queued field, then stops the thread.
+void stopFieldWriter()
+{
+	if (!writerThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		closing = true;
+	}
+	jobsReady.notify_one();
+	writerThread.join();
+
+	if (droppedFields > 0)
+	{
+		std::cout << "Export: " << droppedFields << " fields dropped." << std::endl;
+	}
+}
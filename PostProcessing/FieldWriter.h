@@ -0,0 +1,12 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+
+bool WriteFieldPfm(const char* path, const float* data, int width, int height, int numComponents);
+
+// Background export. QueueFieldPfm copies a width x height field into one of numSlots
+// preallocated slots and returns at once; a writer thread writes the file. When every
+// slot is still waiting to be written the field is dropped instead, unless wait is set.
+bool startFieldWriter(int numSlots, int width, int height, int numComponents);
+bool QueueFieldPfm(const char* path, const float* data, bool wait);
+void stopFieldWriter();
@@ -1,16 +1,31 @@
 #include "stdafx.h"
 #include <chrono>
-#include <thread>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 
 #include "FluidSimulation.h"
 #include "TextureHandler.h"
 #include "Obstacle.h"
+#include "Multigrid.h"
+#include "ConjugateGradient.h"
+#include "Residual.h"
+#include "ComputeJacobi.h"
+#include "ActiveTiles.h"
+#include "PackedJacobi.h"
+#include "CoarseProjection.h"
+#include "ScalarAdvection.h"
+#include "VelocityReduction.h"
+#include "Scheduler.h"
+#include "HeadlessContext.h"
+#include "FieldWriter.h"
+#include "AsyncReadback.h"
+#include "FieldSequence.h"
+#include "Checkpoint.h"
+#include "TileCache.h"
 
 #define CellSize (1.25f)
-#define ViewportWidth (800)
-#define ViewportHeight (600)
-#define GridWidth (ViewportWidth / 2)
-#define GridHeight (ViewportHeight / 2)
+#define MaxJacobiIterations (256)
 
 // Function prototypes
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -31,17 +46,199 @@ bool    keys[1024];
 GLfloat deltaTime = 0.0f;	// Time between current frame and last frame
 GLfloat lastFrame = 0.0f;  	// Time of last frame
 
-static GLuint QuadVao;
-static PingPongTexture velocity, density, pressure;
-static Surface divergence, obstacle, gravity;
+typedef struct Programs_ {
+	Shader advect;
+	Shader computeDivergence;
+	Shader makeGravity;
+	Shader jacobi;
+	Shader redBlack;
+	Shader extrapolate;
+	Shader subtractGradient;
+	Shader advectFused;
+	Shader forceDivergence;
+	Shader jacobiSubtractGradient;
+	Shader macCormack;
+} Programs;
+
+// Simulation grid, independent of the window; set with --grid W H. The stencils need
+// an interior, and the finer density grid must still fit GL_MAX_TEXTURE_SIZE.
+#define MinGridSize (4)
+#define MaxGridSize (16384)
+static int GridWidth = 800;
+static int GridHeight = 600;
+static bool BicubicUpsampling = false;
+
+// Density lives on a grid DensityScale times finer than velocity and pressure;
+// set with --density-scale N.
+static int DensityScale = 1;
+
+// Passive scalars carried by the flow, density first, packed four to a slab;
+// set with --scalars N. --show-scalar N draws field N alone instead of density.
+static int NumScalarFields = 1;
+static int ShownScalar = -1;
 
-static void ResetState()
+static GLuint QuadVao;
+static GLuint MultipleTargetsFbo;
+static PingPongTexture velocity, pressure;
+static PingPongTexture scalars[MaxScalarSlabs];
+static PingPongTexture& density = scalars[0];
+static int NumScalarSlabs = 1;
+static Surface divergence, obstacle, previousPressure;
+static Surface obstacleMask;
+
+// Texture format of each full-resolution field
+static FieldFormat VelocityFormat = { 2, PrecisionHalf };
+static FieldFormat DensityFormat = { 1, PrecisionHalf };
+static FieldFormat PressureFormat = { 1, PrecisionHalf };
+static FieldFormat DivergenceFormat = { 1, PrecisionHalf };
+static FieldFormat ObstacleFormat = { 1, PrecisionUnorm8 };
+static FieldFormat ObstacleMaskFormat = { 1, PrecisionUint8 };
+
+// Advection; the scheme is set with --advection semi|maccormack.
+static float TimeStep = 0.1f;
+static AdvectionScheme Advection = AdvectionSemiLagrangian;
+static Surface velocityScratch[2], densityScratch[2];
+
+// Adaptive time stepping, enabled with --cfl C: each frame advances FrameTime in as
+// many substeps as keep max |u| * TimeStep under C cells, up to MaxSubsteps. max |u|
+// is reduced on the GPU and read back a frame late. Without it every frame is one
+// step of FrameTime, as before. Forces and dissipation were tuned for steps of
+// ReferenceTimeStep and are scaled to the actual step.
+#define ReferenceTimeStep (0.1f)
+static bool AdaptiveTimeStep = false;
+static bool AdaptiveTimeStepAvailable = false;
+static float FrameTime = 0.1f;
+static float MaxCFL = 4.0f;
+static int MaxSubsteps = 4;
+static float MaxSpeed = 0.0f;
+
+// Scheduling: update() runs SimulationRate times per second of wall-clock time, at most
+// MaxCatchUpTicks per rendered frame, and frames are paced by vsync. The density before
+// the last tick is kept for render interpolation. Free running (--free-run) ticks once
+// per frame without vsync or interpolation.
+static double SimulationRate = 60.0;
+static int MaxCatchUpTicks = 4;
+static bool FreeRunning = false;
+static Surface previousDensity;
+
+// Headless batch runs (--headless): updates back to back, with no window, input or
+// pacing, until HeadlessSteps updates have run in total.
+static bool Headless = false;
+static int HeadlessSteps = 1000;
+
+// Export (--output DIR): density is written every OutputInterval steps, and after the last
+// headless step. Readbacks go through a ring of ExportSlots buffers and are handed
+// ExportSlots - 1 exports late to the field writer thread, which writes the files.
+// A frame is dropped when either falls a whole ring behind.
+#define ExportSlots (3)
+static const char* OutputDirectory = nullptr;
+static int OutputInterval = 0;
+static ReadbackRing densityExport;
+
+// Recording (--record FILE): density and velocity are read back as half floats every
+// RecordInterval steps and streamed to a field sequence file by its writer thread.
+// The two rings form a readback group, so a step is recorded with both fields or neither.
+static const char* RecordPath = nullptr;
+static int RecordInterval = 1;
+static ReadbackRing recordRings[2];
+
+// Set while FinishExport drains the rings: the writers then wait for a free slot
+// instead of dropping the last frames.
+static bool ExportFinishing = false;
+
+// History cache (--cache FILE): density every CacheInterval steps, stored as sparse
+// tiles for random access to any frame or region. Tiles with no texel above
+// CacheThreshold are left out and read back as zero; by default only all-zero tiles
+// are, and --cache-threshold T trades values up to T for a smaller cache.
+static const char* CachePath = nullptr;
+static int CacheInterval = 1;
+static float CacheThreshold = 0.0f;
+static ReadbackRing densityCache;
+
+// Checkpoints (--checkpoint FILE N): the full simulation state is written to FILE every
+// N steps in the background; --resume FILE restores it. StepCount counts update() calls
+// and is restored with the state, so a resumed headless run stops at the same step.
+// The adaptive iteration count is restored too, and a checkpoint written with other
+// solver or advection options is refused. Readbacks in flight at the checkpoint (the
+// residual and max |u| of the last frames) are not saved, so with adaptive iterations
+// or time steps a resumed run can pick its next counts a frame or two differently.
+static int StepCount = 0;
+static const char* CheckpointPath = nullptr;
+static int CheckpointInterval = 0;
+static const char* ResumePath = nullptr;
+
+// Pressure solver; set with --solver NAME, NAME one of SolverNames in PressureSolver order,
+// and the multigrid cycle with --cycle v|w.
+static const char* SolverNames[] = { "jacobi", "multigrid", "sor", "cg", "chebyshev", "compute" };
+static PressureSolver Solver = PressureSolverMultigrid;
+static MultigridCycle CycleType = MultigridVCycle;
+static int NumJacobiIterations = 20;
+static int NumMultigridCycles = 2;
+// Red-black SOR sweeps and over-relaxation; set with --sor-sweeps N and --sor-omega W.
+static int NumSORSweeps = 10;
+static float SOROmega = 1.6f;
+static float CGTolerance = 1e-3f;
+static int MaxCGIterations = 60;
+static float ChebyshevSchedule[MaxJacobiIterations];
+// Jacobi benchmark: the B key runs it on the next pressure solve; --benchmark-jacobi N
+// runs it on the solve of update N, prints the result and exits, failing if the
+// compute result does not match.
+static bool BenchmarkRequested = false;
+static int BenchmarkStep = 0;
+static bool BenchmarkPassed = true;
+// Jacobi sweeps per compute dispatch (--jacobi-k N), 1 to MaxIterationsPerDispatch.
+static int IterationsPerDispatch = 4;
+static bool ComputeJacobiAvailable = false;
+// --packed-pressure: 2x2-packed Jacobi, which needs an even grid.
+static bool PackedPressure = false;
+
+// Warm start (--warm-start zero|previous|extrapolate) and residual-driven iteration
+// control (--adaptive, --tolerance T). The configured iteration count of the active
+// solver is the upper bound for the adaptive one.
+static const char* WarmStartNames[] = { "zero", "previous", "extrapolate" };
+static WarmStart WarmStartMode = WarmStartPrevious;
+static bool AdaptiveIterations = false;
+static float ResidualTolerance = 1e-2f;
+static int MaxAdaptiveIterations;
+
+// Fused multi-target passes (--fused)
+static bool FusedPasses = false;
+
+// Half-resolution projection (--half-res-projection) with optional fine Jacobi sweeps
+// on its result (--fine-sweeps N)
+static bool HalfResolutionProjection = false;
+static int FineCorrectionSweeps = 2;
+
+// Shared stencil of the full-resolution surfaces. With --split-boundary, cells flagged
+// in the obstacle mask carry BoundaryStencilBit and run the general shaders, the rest
+// run the branch-free interior ones. Solid cells carry SolidStencilBit and, with
+// --cull-solid, are culled from every pass.
+#define BoundaryStencilBit (1)
+#define SolidStencilBit (2)
+static bool SplitBoundaryPasses = false;
+static bool CullSolidCells = false;
+static GLuint DepthStencil;
+static GLuint InteriorJacobiProgram, InteriorDivergenceProgram, InteriorGradientProgram;
+
+// Sparse active tiles (--sparse-tiles). Advection of the full-resolution scalar slabs
+// only shades tiles near moving fluid or density; ForceRegion is the jet of
+// gravityField.fs in cells, which is always active. Velocity advection, forces,
+// divergence, the pressure solve and the gradient subtraction always cover the whole
+// grid, so only scalar advection gets cheaper with a smaller active area.
+static bool SparseTiles = false;
+static bool ActiveTilesAvailable = false;
+static float ActivityThreshold = 1e-2f;
+static int ForceRegion[4];
+
+void ResetState()
 {
+	glActiveTexture(GL_TEXTURE3); glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE2); glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE1); glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE0); glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glDisable(GL_BLEND);
+	glDisable(GL_STENCIL_TEST);
 }
 
 GLuint CreateQuad()
@@ -89,9 +286,23 @@ GLuint CreateQuad()
 
 
 
+// Scalar slab formats: DensityFormat's precision, four channels per slab, with the
+// last slab narrowed to the remainder (three rounds up to four, RGB is not renderable).
+static FieldFormat ScalarSlabFormat(int slab)
+{
+	int remaining = NumScalarFields - 4 * slab;
+	FieldFormat format = DensityFormat;
+	if (NumScalarFields > 1)
+	{
+		format.NumComponents = (remaining >= 3) ? 4 : remaining;
+	}
+	return format;
+}
+
 void initDensity(Shader& makeDensity)
 {
 	makeDensity.Use();
+	glViewport(0, 0, density.Ping.Width, density.Ping.Height);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, density.Ping.FboHandle);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -100,6 +311,7 @@ void initDensity(Shader& makeDensity)
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	ResetState();
+	glViewport(0, 0, GridWidth, GridHeight);
 }
 
 void SwapSurfaces(PingPongTexture* slab)
@@ -116,105 +328,534 @@ void ClearSurface(Surface s, float v)
 	glClear(GL_COLOR_BUFFER_BIT);
 }
 
-void Advect(Shader& advect, Surface velocity, Surface source, Surface obstacles, Surface dest, float dissipation)
+void CopySurface(Surface source, Surface dest)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, source.FboHandle);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dest.FboHandle);
+	glBlitFramebuffer(0, 0, source.Width, source.Height, 0, 0, dest.Width, dest.Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Attaches two surfaces to the shared multi-target FBO and binds it.
+void BindTargets(Surface first, Surface second)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, MultipleTargetsFbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, first.TextureHandle, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, second.TextureHandle, 0);
+}
+
+static bool IsFullResolution(Surface dest)
+{
+	return dest.Width == GridWidth && dest.Height == GridHeight;
+}
+
+// Sets stencilBit on every cell whose obstacle mask shares a bit with maskBits.
+static void MarkStencil(GLuint boundaryStencil, GLuint maskBits, GLuint stencilBit)
+{
+	glUniform1ui(glGetUniformLocation(boundaryStencil, "Bits"), maskBits);
+	glStencilMask(stencilBit);
+	glStencilFunc(GL_ALWAYS, stencilBit, stencilBit);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// Creates the shared depth-stencil buffer, attaches it to every full-resolution
+// target and fills it once from the obstacle mask.
+void createSimulationStencil()
+{
+	DepthStencil = createDepthStencil(GridWidth, GridHeight);
+	std::vector<Surface> targets = { velocity.Ping, velocity.Pong, pressure.Ping, pressure.Pong, divergence };
+	for (int i = 0; i < NumScalarSlabs; i++)
+	{
+		targets.push_back(scalars[i].Ping);
+		targets.push_back(scalars[i].Pong);
+	}
+	for (Surface target : targets)
+	{
+		if (IsFullResolution(target))
+		{
+			attachDepthStencil(target, DepthStencil);
+		}
+	}
+	Surface multipleTargets = { MultipleTargetsFbo, 0, 0, GridWidth, GridHeight };
+	BindTargets(velocity.Ping, divergence);
+	attachDepthStencil(multipleTargets, DepthStencil);
+
+	Shader boundaryStencil("defaultVS.vs", "boundaryStencil.fs");
+	GLuint p = boundaryStencil.Program;
+	glUseProgram(p);
+	glUniform1i(glGetUniformLocation(p, "ObstacleMask"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, divergence.FboHandle);
+	glClearStencil(0);
+	glClear(GL_STENCIL_BUFFER_BIT);
+
+	glEnable(GL_STENCIL_TEST);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	MarkStencil(p, 0xFF, BoundaryStencilBit);
+	MarkStencil(p, 1, SolidStencilBit);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	glStencilMask(0);
+
+	// Culled cells keep whatever they hold, so solid velocity and density are zeroed
+	// once here, which is what advection and the gradient pass used to write.
+	if (CullSolidCells)
+	{
+		glUniform1ui(glGetUniformLocation(p, "Bits"), 1);
+		glStencilFunc(GL_EQUAL, SolidStencilBit, SolidStencilBit);
+		std::vector<Surface> fields = { velocity.Ping, velocity.Pong };
+		for (int i = 0; i < NumScalarSlabs; i++)
+		{
+			fields.push_back(scalars[i].Ping);
+			fields.push_back(scalars[i].Pong);
+		}
+		for (Surface field : fields)
+		{
+			if (!IsFullResolution(field))
+				continue;
+			glBindFramebuffer(GL_FRAMEBUFFER, field.FboHandle);
+			glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		}
+	}
+	glDeleteProgram(p);
+
+	if (SplitBoundaryPasses)
+	{
+		InteriorJacobiProgram = Shader("defaultVS.vs", "jacobiInterior.fs").Program;
+		InteriorDivergenceProgram = Shader("defaultVS.vs", "computeDivergenceInterior.fs").Program;
+		InteriorGradientProgram = Shader("defaultVS.vs", "subtractGradientInterior.fs").Program;
+	}
+
+	ResetState();
+}
+
+// Only full-resolution surfaces share the stencil; coarser multigrid levels are drawn in full.
+static bool HasStencil(Surface dest)
+{
+	return DepthStencil && IsFullResolution(dest);
+}
+
+static bool UseBoundarySplit(Surface dest)
+{
+	return SplitBoundaryPasses && HasStencil(dest);
+}
+
+// Rejects the solid cells of dest in the stencil test, before they are shaded.
+// ResetState turns the test off again.
+static void CullSolid(Surface dest)
+{
+	if (!CullSolidCells || !HasStencil(dest))
+		return;
+
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_EQUAL, 0, SolidStencilBit);
+}
+
+// Draws the full-screen quad into dest, or, if sparse, only its active tiles. Only
+// scalar advection draws sparse; every other pass draws the full quad.
+static void DrawQuad(Surface dest, bool sparse)
+{
+	if (sparse && SparseTiles && ActiveTilesAvailable && IsFullResolution(dest))
+	{
+		DrawActiveTiles();
+		return;
+	}
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// Draws the quad with the interior program on unmarked cells and the general
+// program on boundary cells. With no interior program the general one covers everything.
+static void DrawSplit(Surface dest, GLuint general, GLuint interior)
+{
+	if (!interior)
+	{
+		glUseProgram(general);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		return;
+	}
+
+	GLuint culled = CullSolidCells ? SolidStencilBit : 0;
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_EQUAL, 0, BoundaryStencilBit);
+	glUseProgram(interior);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glStencilFunc(GL_EQUAL, BoundaryStencilBit, BoundaryStencilBit | culled);
+	glUseProgram(general);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// dest may be finer than velocity; the back-trace is then scaled to dest cells.
+// A negative timeStep traces forward. With sparse set, only the active tiles are drawn.
+// Values advection writes into solid cells.
+static const float VelocitySolidValue[4] = { 0.0f, 1.0f, 0.0f, 0.0f };
+static const float ScalarSolidValue[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+static void AdvectStep(Shader& advect, Surface velocity, Surface source, Surface obstacles, Surface dest, float timeStep, float dissipation, const float* solidValue, bool sparse)
 {
 	GLuint p = advect.Program;
 	glUseProgram(p);
-	float TimeStep = 0.1f;
 
 	GLint inverseSize = glGetUniformLocation(p, "InverseSize");
-	GLint timeStep = glGetUniformLocation(p, "TimeStep");
+	GLint timeStepLoc = glGetUniformLocation(p, "TimeStep");
+	GLint velocityScale = glGetUniformLocation(p, "VelocityScale");
 	GLint dissLoc = glGetUniformLocation(p, "Dissipation");
 	GLint sourceTexture = glGetUniformLocation(p, "SourceTexture");
 	GLint obstaclesTexture = glGetUniformLocation(p, "Obstacles");
 
-	glUniform2f(inverseSize, 1.0f / GridWidth * 0.5, 1.0f / GridHeight * 0.5);
-	glUniform1f(timeStep, TimeStep);
+	glUniform2f(inverseSize, 1.0f / dest.Width, 1.0f / dest.Height);
+	glUniform1f(timeStepLoc, timeStep);
+	glUniform1f(velocityScale, (float)dest.Width / velocity.Width);
 	glUniform1f(dissLoc, dissipation);
 	glUniform1i(sourceTexture, 1);
 	glUniform1i(obstaclesTexture, 2);
+	glUniform1i(glGetUniformLocation(p, "DensityScale"), dest.Width / obstacles.Width);
+	glUniform4fv(glGetUniformLocation(p, "SolidValue"), 1, solidValue);
 
+	glViewport(0, 0, dest.Width, dest.Height);
 	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	CullSolid(dest);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	DrawQuad(dest, sparse);
+
+	ResetState();
+	glViewport(0, 0, GridWidth, GridHeight);
+}
+
+void Advect(Shader& advect, Surface velocity, Surface source, Surface obstacles, Surface dest, float dissipation, const float* solidValue, bool sparse)
+{
+	AdvectStep(advect, velocity, source, obstacles, dest, TimeStep, dissipation, solidValue, sparse);
+}
+
+// Second-order MacCormack advection: a backward-traced step into forward, a
+// forward-traced step of that back into backward, and a correction by half their
+// round-trip error. The result is clamped to the cells the first step interpolated,
+// which keeps the scheme from creating new extrema.
+void AdvectMacCormack(Shader& advect, Shader& macCormack, Surface velocity, Surface source, Surface obstacles, Surface forward, Surface backward, Surface dest, float dissipation, const float* solidValue, bool sparse)
+{
+	AdvectStep(advect, velocity, source, obstacles, forward, TimeStep, 1.0f, solidValue, sparse);
+	AdvectStep(advect, velocity, forward, obstacles, backward, -TimeStep, 1.0f, solidValue, sparse);
+
+	GLuint p = macCormack.Program;
+	glUseProgram(p);
+
+	glUniform2f(glGetUniformLocation(p, "InverseSize"), 1.0f / dest.Width, 1.0f / dest.Height);
+	glUniform1f(glGetUniformLocation(p, "TimeStep"), TimeStep);
+	glUniform1f(glGetUniformLocation(p, "VelocityScale"), (float)dest.Width / velocity.Width);
+	glUniform1f(glGetUniformLocation(p, "Dissipation"), dissipation);
+	glUniform1i(glGetUniformLocation(p, "Source"), 1);
+	glUniform1i(glGetUniformLocation(p, "Forward"), 2);
+	glUniform1i(glGetUniformLocation(p, "Backward"), 3);
+	glUniform1i(glGetUniformLocation(p, "Obstacles"), 4);
+	glUniform1i(glGetUniformLocation(p, "DensityScale"), dest.Width / obstacles.Width);
+	glUniform4fv(glGetUniformLocation(p, "SolidValue"), 1, solidValue);
+
+	glViewport(0, 0, dest.Width, dest.Height);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	CullSolid(dest);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, forward.TextureHandle);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, backward.TextureHandle);
+	glActiveTexture(GL_TEXTURE4);
+	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	DrawQuad(dest, sparse);
+
+	glActiveTexture(GL_TEXTURE4); glBindTexture(GL_TEXTURE_2D, 0);
+	ResetState();
+	glViewport(0, 0, GridWidth, GridHeight);
+}
+
+// Advects field->Ping into field->Pong with the configured scheme and swaps them.
+// Velocity is never drawn sparse: gravity acts on every cell, so no tile of it is
+// quiescent, and skipped tiles of Pong would keep the last step's unprojected velocity.
+static void AdvectField(Programs& programs, Surface velocity, PingPongTexture* field, Surface* scratch, float dissipation, const float* solidValue, bool sparse)
+{
+	if (Advection == AdvectionMacCormack)
+	{
+		AdvectMacCormack(programs.advect, programs.macCormack, velocity, field->Ping, obstacle, scratch[0], scratch[1], field->Pong, dissipation, solidValue, sparse);
+	}
+	else
+	{
+		Advect(programs.advect, velocity, field->Ping, obstacle, field->Pong, dissipation, solidValue, sparse);
+	}
+	SwapSurfaces(field);
+}
+
+// Advects velocity and density in one pass. Density is traced along the advected
+// velocity of its cell, which the pass has at hand, so the result matches the
+// separate passes up to the rounding of the stored velocity.
+void AdvectFused(Shader& advectFused, Surface velocity, Surface density, Surface obstacles, Surface velocityDest, Surface densityDest, float velocityDissipation, float densityDissipation)
+{
+	GLuint p = advectFused.Program;
+	glUseProgram(p);
+
+	GLint inverseSize = glGetUniformLocation(p, "InverseSize");
+	GLint timeStep = glGetUniformLocation(p, "TimeStep");
+	GLint velocityDissLoc = glGetUniformLocation(p, "VelocityDissipation");
+	GLint densityDissLoc = glGetUniformLocation(p, "DensityDissipation");
+	GLint densityTexture = glGetUniformLocation(p, "DensityTexture");
+	GLint obstaclesTexture = glGetUniformLocation(p, "Obstacles");
+
+	glUniform2f(inverseSize, 1.0f / GridWidth, 1.0f / GridHeight);
+	glUniform1f(timeStep, TimeStep);
+	glUniform1f(velocityDissLoc, velocityDissipation);
+	glUniform1f(densityDissLoc, densityDissipation);
+	glUniform1i(densityTexture, 1);
+	glUniform1i(obstaclesTexture, 2);
+
+	BindTargets(velocityDest, densityDest);
+	CullSolid(velocityDest);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, density.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	ResetState();
 }
 
-void ComputeDivergence(Shader& computeDivergence, Surface velocity, Surface obstacles, Surface dest)
+// Computes the divergence of velocity and adds the force in one pass.
+void AddForceAndDivergence(Shader& forceDivergence, Surface velocity, Surface obstacleMask, Surface velocityDest, Surface divergenceDest)
 {
-	GLuint p = computeDivergence.Program;
+	GLuint p = forceDivergence.Program;
 	glUseProgram(p);
 
+	GLint inverseSize = glGetUniformLocation(p, "InverseSize");
 	GLint halfCell = glGetUniformLocation(p, "HalfInverseCellSize");
+	GLint sampler = glGetUniformLocation(p, "ObstacleMask");
+	glUniform2f(inverseSize, 1.0f / GridWidth, 1.0f / GridHeight);
+	glUniform1f(glGetUniformLocation(p, "ForceScale"), TimeStep / ReferenceTimeStep);
 	glUniform1f(halfCell, 0.5f / CellSize);
-	GLint sampler = glGetUniformLocation(p, "Obstacles");
 	glUniform1i(sampler, 1);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	BindTargets(velocityDest, divergenceDest);
+	CullSolid(velocityDest);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
 	ResetState();
 }
 
-void Jacobi(Shader& jacobi, Surface pressure, Surface divergence, Surface obstacles, Surface dest)
+void ComputeDivergence(Shader& computeDivergence, Surface velocity, Surface obstacleMask, Surface dest, float cellSize)
 {
-	GLuint p = jacobi.Program;
+	GLuint programs[] = { computeDivergence.Program, InteriorDivergenceProgram };
+	int numPrograms = UseBoundarySplit(dest) ? 2 : 1;
+	for (int i = 0; i < numPrograms; i++)
+	{
+		GLuint p = programs[i];
+		glUseProgram(p);
+
+		GLint halfCell = glGetUniformLocation(p, "HalfInverseCellSize");
+		glUniform1f(halfCell, 0.5f / cellSize);
+		GLint sampler = glGetUniformLocation(p, "ObstacleMask");
+		glUniform1i(sampler, 1);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	CullSolid(dest);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	DrawSplit(dest, programs[0], (numPrograms == 2) ? programs[1] : 0);
+	ResetState();
+}
+
+void Jacobi(Shader& jacobi, Surface pressure, Surface divergence, Surface obstacleMask, Surface dest, float cellSize, float omega)
+{
+	GLuint programs[] = { jacobi.Program, InteriorJacobiProgram };
+	int numPrograms = UseBoundarySplit(dest) ? 2 : 1;
+	for (int i = 0; i < numPrograms; i++)
+	{
+		GLuint p = programs[i];
+		glUseProgram(p);
+
+		GLint alpha = glGetUniformLocation(p, "Alpha");
+		GLint inverseBeta = glGetUniformLocation(p, "InverseBeta");
+		GLint omegaLoc = glGetUniformLocation(p, "Omega");
+		GLint dSampler = glGetUniformLocation(p, "Divergence");
+		GLint oSampler = glGetUniformLocation(p, "ObstacleMask");
+
+		glUniform1f(alpha, -cellSize * cellSize);
+		glUniform1f(inverseBeta, 0.25f);
+		glUniform1f(omegaLoc, omega);
+		glUniform1i(dSampler, 1);
+		glUniform1i(oSampler, 2);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	CullSolid(dest);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, divergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	DrawSplit(dest, programs[0], (numPrograms == 2) ? programs[1] : 0);
+
+	ResetState();
+}
+
+// One red-black SOR sweep, updating pressure in place. Each half pass reads only
+// cells of the other color, so a texture barrier between them makes the feedback loop well defined.
+void RedBlackSOR(Shader& redBlack, Surface pressure, Surface divergence, Surface obstacleMask, float cellSize, float omega)
+{
+	GLuint p = redBlack.Program;
 	glUseProgram(p);
 
 	GLint alpha = glGetUniformLocation(p, "Alpha");
 	GLint inverseBeta = glGetUniformLocation(p, "InverseBeta");
+	GLint omegaLoc = glGetUniformLocation(p, "Omega");
+	GLint parity = glGetUniformLocation(p, "Parity");
 	GLint dSampler = glGetUniformLocation(p, "Divergence");
-	GLint oSampler = glGetUniformLocation(p, "Obstacles");
+	GLint oSampler = glGetUniformLocation(p, "ObstacleMask");
 
-	glUniform1f(alpha, -CellSize * CellSize);
+	glUniform1f(alpha, -cellSize * cellSize);
 	glUniform1f(inverseBeta, 0.25f);
+	glUniform1f(omegaLoc, omega);
 	glUniform1i(dSampler, 1);
 	glUniform1i(oSampler, 2);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glBindFramebuffer(GL_FRAMEBUFFER, pressure.FboHandle);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, divergence.TextureHandle);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+
+	for (int color = 0; color < 2; color++)
+	{
+		glTextureBarrierNV();
+		glUniform1i(parity, color);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+
+	ResetState();
+}
+
+// Fills weights with the Chebyshev relaxation schedule for numIterations weighted
+// Jacobi sweeps on a width x height grid. Jacobi on the 5-point Laplacian has
+// eigenvalues of D^-1 A in [lambdaMin, 2 - lambdaMin]; the weights are the
+// reciprocal roots of the Chebyshev polynomial over that interval.
+void ChebyshevWeights(int width, int height, int numIterations, float* weights)
+{
+	const float Pi = 3.14159265f;
+	float lambdaMin = 1.0f - 0.5f * (cosf(Pi / (width + 1)) + cosf(Pi / (height + 1)));
+
+	// A budget of N sweeps cannot resolve modes much below 1/N^2. Targeting them
+	// anyway only produces huge weights that amplify half-float round-off.
+	float budgetFloor = 1.0f / (numIterations * numIterations);
+	if (lambdaMin < budgetFloor) lambdaMin = budgetFloor;
+	float lambdaMax = 2.0f - lambdaMin;
+
+	float center = 0.5f * (lambdaMax + lambdaMin);
+	float radius = 0.5f * (lambdaMax - lambdaMin);
+
+	// Alternate small and large weights so intermediate iterates stay bounded.
+	for (int k = 0; k < numIterations; k++)
+	{
+		int root = (k % 2 == 0) ? k / 2 : numIterations - 1 - k / 2;
+		float tau = center + radius * cosf(Pi * (2 * root + 1) / (2 * numIterations));
+		weights[k] = 1.0f / tau;
+	}
+}
+
+void Extrapolate(Shader& extrapolate, Surface current, Surface previous, Surface dest)
+{
+	GLuint p = extrapolate.Program;
+	glUseProgram(p);
+
+	GLint sampler = glGetUniformLocation(p, "Previous");
+	glUniform1i(sampler, 1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, current.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, previous.TextureHandle);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	ResetState();
 }
 
-void SubtractGradient(Shader& subtractGradient, Surface velocity, Surface pressure, Surface obstacles, Surface dest)
+void SubtractGradient(Shader& subtractGradient, Surface velocity, Surface pressure, Surface obstacleMask, Surface dest)
 {
 	float GradientScale = 1.125f / CellSize;
 
-	GLuint p = subtractGradient.Program;
+	GLuint programs[] = { subtractGradient.Program, InteriorGradientProgram };
+	int numPrograms = UseBoundarySplit(dest) ? 2 : 1;
+	for (int i = 0; i < numPrograms; i++)
+	{
+		GLuint p = programs[i];
+		glUseProgram(p);
+
+		GLint gradientScale = glGetUniformLocation(p, "GradientScale");
+		glUniform1f(gradientScale, GradientScale);
+		GLint sampler = glGetUniformLocation(p, "Pressure");
+		glUniform1i(sampler, 1);
+		sampler = glGetUniformLocation(p, "ObstacleMask");
+		glUniform1i(sampler, 2);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	CullSolid(dest);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	DrawSplit(dest, programs[0], (numPrograms == 2) ? programs[1] : 0);
+
+	ResetState();
+}
+
+// Runs the last Jacobi iteration and subtracts the resulting gradient in one pass.
+void JacobiSubtractGradient(Shader& jacobiSubtractGradient, Surface velocity, Surface pressure, Surface divergence, Surface obstacleMask, Surface velocityDest, Surface pressureDest)
+{
+	GLuint p = jacobiSubtractGradient.Program;
 	glUseProgram(p);
 
+	GLint alpha = glGetUniformLocation(p, "Alpha");
+	GLint inverseBeta = glGetUniformLocation(p, "InverseBeta");
 	GLint gradientScale = glGetUniformLocation(p, "GradientScale");
-	glUniform1f(gradientScale, GradientScale);
-	GLint halfCell = glGetUniformLocation(p, "HalfInverseCellSize");
-	glUniform1f(halfCell, 0.5f / CellSize);
-	GLint sampler = glGetUniformLocation(p, "Pressure");
-	glUniform1i(sampler, 1);
-	sampler = glGetUniformLocation(p, "Obstacles");
-	glUniform1i(sampler, 2);
+	glUniform1f(alpha, -CellSize * CellSize);
+	glUniform1f(inverseBeta, 0.25f);
+	glUniform1f(gradientScale, 1.125f / CellSize);
+	glUniform1i(glGetUniformLocation(p, "Pressure"), 1);
+	glUniform1i(glGetUniformLocation(p, "Divergence"), 2);
+	glUniform1i(glGetUniformLocation(p, "ObstacleMask"), 3);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	BindTargets(velocityDest, pressureDest);
+	CullSolid(velocityDest);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	glBindTexture(GL_TEXTURE_2D, divergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	ResetState();
@@ -225,9 +866,11 @@ void AddForce(Shader& makeGravity, Surface velocitySource, Surface velocityDest)
 	makeGravity.Use();
 
 	GLint inverseSize = glGetUniformLocation(makeGravity.Program, "InverseSize");
-	glUniform2f(inverseSize, 1.0f / GridWidth * 0.5, 1.0f / GridHeight * 0.5);
+	glUniform2f(inverseSize, 1.0f / GridWidth, 1.0f / GridHeight);
+	glUniform1f(glGetUniformLocation(makeGravity.Program, "ForceScale"), TimeStep / ReferenceTimeStep);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, velocityDest.FboHandle);
+	CullSolid(velocityDest);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, velocitySource.TextureHandle);
 
@@ -236,97 +879,1183 @@ void AddForce(Shader& makeGravity, Surface velocitySource, Surface velocityDest)
 	ResetState();
 }
 
+void ComputeJacobiIterations(int numIterations)
+{
+	for (int i = 0; i < numIterations; i += IterationsPerDispatch)
+	{
+		int k = (numIterations - i < IterationsPerDispatch) ? numIterations - i : IterationsPerDispatch;
+		ComputeJacobi(pressure.Ping, divergence, obstacle, pressure.Pong, CellSize, 1.0f, k);
+		SwapSurfaces(&pressure);
+	}
+}
+
+// Largest difference between compute and fragment Jacobi accepted by the benchmark,
+// relative to the largest fragment pressure. Both round every iteration to half floats.
+#define ComputeJacobiTolerance (1e-2f)
+
+// Runs plain Jacobi, Chebyshev Jacobi and, if available, the tiled compute Jacobi
+// from the same pressure and divergence and prints the GPU time and RMS residual
+// of each. The compute result is validated against the fragment one. The pressure
+// is restored afterwards. Returns false if the compute result is out of tolerance.
+bool BenchmarkJacobi(Shader& jacobi)
+{
+	const char* names[] = { "jacobi   ", "chebyshev", "compute  " };
+	bool passed = true;
+	std::vector<float> reference(GridWidth * GridHeight), result(GridWidth * GridHeight);
+
+	Surface saved = createSurface(GridWidth, GridHeight, PressureFormat);
+	CopySurface(pressure.Ping, saved);
+
+	ResidualNorm(pressure.Ping, divergence, obstacleMask, CellSize);
+	std::cout << "Benchmark: initial residual " << ReadResidualNorm() << std::endl;
+
+	GLuint query;
+	glGenQueries(1, &query);
+	int numModes = ComputeJacobiAvailable ? 3 : 2;
+	for (int mode = 0; mode < numModes; mode++)
+	{
+		CopySurface(saved, pressure.Ping);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		if (mode == 2)
+		{
+			ComputeJacobiIterations(NumJacobiIterations);
+		}
+		else
+		{
+			for (int i = 0; i < NumJacobiIterations; i++)
+			{
+				float omega = (mode == 0) ? 1.0f : ChebyshevSchedule[i];
+				Jacobi(jacobi, pressure.Ping, divergence, obstacleMask, pressure.Pong, CellSize, omega);
+				SwapSurfaces(&pressure);
+			}
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		ResidualNorm(pressure.Ping, divergence, obstacleMask, CellSize);
+		std::cout << "Benchmark: " << names[mode] << " x" << NumJacobiIterations
+			<< " residual " << ReadResidualNorm() << ", " << elapsed / 1000 << " us" << std::endl;
+
+		if (mode == 0 || mode == 2)
+		{
+			glBindTexture(GL_TEXTURE_2D, pressure.Ping.TextureHandle);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, (mode == 0) ? reference.data() : result.data());
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+	glDeleteQueries(1, &query);
+
+	if (ComputeJacobiAvailable)
+	{
+		// The solid border ring reads outside the grid and is never used, so it is skipped.
+		float maxError = 0, maxPressure = 0;
+		for (int y = 1; y < GridHeight - 1; y++)
+		{
+			for (int x = 1; x < GridWidth - 1; x++)
+			{
+				float error = fabsf(reference[y * GridWidth + x] - result[y * GridWidth + x]);
+				if (error > maxError) maxError = error;
+				if (fabsf(reference[y * GridWidth + x]) > maxPressure) maxPressure = fabsf(reference[y * GridWidth + x]);
+			}
+		}
+		float tolerance = ComputeJacobiTolerance * ((maxPressure > 1.0f) ? maxPressure : 1.0f);
+		passed = maxError <= tolerance;
+		std::cout << "Benchmark: compute vs fragment max difference " << maxError << " (tolerance " << tolerance
+			<< "): " << (passed ? "passed" : "FAILED") << std::endl;
+	}
+
+	CopySurface(saved, pressure.Ping);
+	glDeleteFramebuffers(1, &saved.FboHandle);
+	glDeleteTextures(1, &saved.TextureHandle);
+	return passed;
+}
+
+// Iteration count of the active fixed-count solver; CG has its own tolerance.
+static int* ActiveIterationCount()
+{
+	switch (Solver)
+	{
+	case PressureSolverMultigrid: return &NumMultigridCycles;
+	case PressureSolverRedBlackSOR: return &NumSORSweeps;
+	case PressureSolverConjugateGradient: return 0;
+	default: return &NumJacobiIterations;
+	}
+}
+
+// Adjusts the iteration count from the residual read back from an earlier frame:
+// double it while the tolerance is missed, back off by one once it is met.
+static void UpdateIterationCount()
+{
+	int* count = ActiveIterationCount();
+	float norm;
+	if (!count || !PollResidualNorm(&norm))
+		return;
+
+	int previous = *count;
+	if (norm > ResidualTolerance)
+		*count = (2 * *count < MaxAdaptiveIterations) ? 2 * *count : MaxAdaptiveIterations;
+	else if (*count > 1)
+		(*count)--;
+
+	if (Solver == PressureSolverChebyshevJacobi && *count != previous)
+	{
+		ChebyshevWeights(GridWidth, GridHeight, *count, ChebyshevSchedule);
+	}
+}
+
+// Prints the GPU memory of each full-resolution field and an estimate of the bytes
+// it moves per step. Every full-surface read or write of a pass counts once; the
+// texture cache is assumed to absorb the neighbor fetches of the stencils. The
+// per-field rows leave out the solver levels, CG vectors, tile and packed textures;
+// the last line is the total of every surface actually created. Readback buffers
+// are not counted.
+static void ReportFieldFormats()
+{
+	typedef struct FieldUsage_ {
+		const char* Name;
+		FieldFormat Format;
+		int Scale;
+		int NumSurfaces;
+		int ReadsPerStep;
+		int WritesPerStep;
+	} FieldUsage;
+
+	// Finest-level pressure sweeps per step. CG is counted once and its own vectors are left out.
+	int sweeps;
+	switch (Solver)
+	{
+	case PressureSolverMultigrid: sweeps = NumMultigridCycles * (PreSmoothingSteps + PostSmoothingSteps); break;
+	case PressureSolverRedBlackSOR: sweeps = NumSORSweeps; break;
+	case PressureSolverConjugateGradient: sweeps = 1; break;
+	case PressureSolverComputeJacobi: sweeps = (NumJacobiIterations + IterationsPerDispatch - 1) / IterationsPerDispatch; break;
+	default: sweeps = NumJacobiIterations; break;
+	}
+
+	int numPressure = (Solver == PressureSolverRedBlackSOR) ? 1 : 2;
+	if (WarmStartMode == WarmStartExtrapolate) numPressure++;
+
+	// MacCormack adds two scratch surfaces per field and two passes that write and re-read them.
+	int scratch = (Advection == AdvectionMacCormack) ? 2 : 0;
+
+	// Render interpolation keeps, and copies once per step, the previous density.
+	int interpolated = FreeRunning ? 0 : 1;
+
+	FieldUsage fields[] = {
+		{ "velocity", VelocityFormat, 1, 2 + scratch, (FusedPasses ? 3 : 5) + 2 * scratch, 3 + scratch },
+		{ "scalars", ScalarSlabFormat(0), DensityScale, 2 * NumScalarSlabs + scratch + interpolated, NumScalarSlabs * (1 + 2 * scratch) + interpolated, NumScalarSlabs * (1 + scratch) + interpolated },
+		{ "pressure", PressureFormat, 1, numPressure, sweeps + 1, sweeps },
+		{ "divergence", DivergenceFormat, 1, 1, sweeps, 1 },
+		{ "obstacle", ObstacleFormat, 1, 1, FusedPasses ? 1 : 2, 0 },
+		{ "obstacle mask", ObstacleMaskFormat, 1, 1, sweeps + 2, 0 },
+	};
+
+	const float MB = 1024.0f * 1024.0f;
+	float totalBytes = 0, totalMoved = 0;
+	std::cout << "Full-resolution field formats (" << GridWidth << "x" << GridHeight << "):" << std::endl;
+	for (FieldUsage field : fields)
+	{
+		float texelBytes = (float)BytesPerTexel(field.Format) * GridWidth * GridHeight * field.Scale * field.Scale;
+		float bytes = texelBytes * field.NumSurfaces;
+		float moved = texelBytes * (field.ReadsPerStep + field.WritesPerStep);
+		totalBytes += bytes;
+		totalMoved += moved;
+		std::cout << "  " << field.Name << ": " << FormatName(field.Format) << " x" << field.NumSurfaces
+			<< ", " << bytes / MB << " MB, " << moved / MB << " MB/step" << std::endl;
+	}
+	std::cout << "  total: " << totalBytes / MB << " MB, " << totalMoved / MB << " MB/step" << std::endl;
+	std::cout << "All surfaces allocated: " << SurfaceBytesAllocated() / MB << " MB" << std::endl;
+}
+
 void initialize()
 {
 	Shader makeDensity("defaultVS.vs", "densityField.fs");
 
 	QuadVao = CreateQuad();
+	glViewport(0, 0, GridWidth, GridHeight);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	velocity = createPingPongTexture(WIDTH, HEIGHT, 2);
-	density = createPingPongTexture(WIDTH, HEIGHT, 1); 
-	pressure = createPingPongTexture(WIDTH, HEIGHT, 2);
+	velocity = createPingPongTexture(GridWidth, GridHeight, VelocityFormat);
+	NumScalarSlabs = (NumScalarFields + 3) / 4;
+	for (int i = 0; i < NumScalarSlabs; i++)
+	{
+		scalars[i] = createPingPongTexture(GridWidth * DensityScale, GridHeight * DensityScale, ScalarSlabFormat(i));
+		ClearSurface(scalars[i].Ping, 0);
+		ClearSurface(scalars[i].Pong, 0);
+	}
+	if (NumScalarSlabs > 1)
+	{
+		createScalarAdvection();
+	}
 
-	divergence = createSurface(WIDTH, HEIGHT, 3);
-	obstacle = createSurface(WIDTH, HEIGHT, 3);
-	gravity = createSurface(WIDTH, HEIGHT, 2);
+	if (Solver == PressureSolverRedBlackSOR && !GLEW_NV_texture_barrier)
+	{
+		std::cout << "NV_texture_barrier not supported, falling back to Jacobi." << std::endl;
+		Solver = PressureSolverJacobi;
+	}
+
+	// Red-black SOR works in place and needs no second pressure buffer.
+	if (Solver == PressureSolverRedBlackSOR && !HalfResolutionProjection)
+	{
+		pressure.Ping = createSurface(GridWidth, GridHeight, PressureFormat);
+		pressure.Pong = pressure.Ping;
+	}
+	else
+	{
+		pressure = createPingPongTexture(GridWidth, GridHeight, PressureFormat);
+	}
+
+	// Extrapolation needs a scratch buffer, which the in-place solver does not have.
+	if (WarmStartMode == WarmStartExtrapolate && Solver == PressureSolverRedBlackSOR)
+	{
+		WarmStartMode = WarmStartPrevious;
+	}
+	if (WarmStartMode == WarmStartExtrapolate)
+	{
+		previousPressure = createSurface(GridWidth, GridHeight, PressureFormat);
+	}
+
+	if (Advection == AdvectionMacCormack)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			velocityScratch[i] = createSurface(GridWidth, GridHeight, VelocityFormat);
+			densityScratch[i] = createSurface(density.Ping.Width, density.Ping.Height, ScalarSlabFormat(0));
+		}
+	}
+
+	divergence = createSurface(GridWidth, GridHeight, DivergenceFormat);
+	obstacle = createSurface(GridWidth, GridHeight, ObstacleFormat);
+	obstacleMask = createSurface(GridWidth, GridHeight, ObstacleMaskFormat);
 
 	//createGravityField();
 	initDensity(makeDensity);
+	if (!FreeRunning)
+	{
+		previousDensity = createSurface(density.Ping.Width, density.Ping.Height, ScalarSlabFormat(0));
+		CopySurface(density.Ping, previousDensity);
+	}
+
+	createObstacles(obstacle, obstacleMask, GridWidth, GridHeight);
+	glBindVertexArray(QuadVao);
+
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glGenFramebuffers(1, &MultipleTargetsFbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, MultipleTargetsFbo);
+	glDrawBuffers(2, drawBuffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (SplitBoundaryPasses || CullSolidCells)
+	{
+		createSimulationStencil();
+	}
 
-	createObstacles(obstacle, WIDTH, HEIGHT);
+	if (Solver == PressureSolverMultigrid)
+	{
+		createMultigrid(obstacle, GridWidth, GridHeight, CellSize);
+	}
+	else if (Solver == PressureSolverConjugateGradient)
+	{
+		createConjugateGradient(obstacleMask, GridWidth, GridHeight, CellSize);
+	}
+
+	// The tiled compute Jacobi writes pressure through an r16f image.
+	ComputeJacobiAvailable = PressureFormat.NumComponents == 1 && PressureFormat.Precision == PrecisionHalf && createComputeJacobi();
+	if (Solver == PressureSolverComputeJacobi && !ComputeJacobiAvailable)
+	{
+		Solver = PressureSolverJacobi;
+	}
+
+	// The Jacobi solvers can run on 2x2-packed pressure and divergence. An odd row or
+	// column would have no packed texel, so odd grids keep the usual layout.
+	if (PackedPressure && (GridWidth % 2 != 0 || GridHeight % 2 != 0))
+	{
+		std::cout << "Packed pressure needs an even grid; using the unpacked solver." << std::endl;
+		PackedPressure = false;
+	}
+	if (PackedPressure && (Solver == PressureSolverJacobi || Solver == PressureSolverChebyshevJacobi))
+	{
+		createPackedJacobi(obstacleMask, GridWidth, GridHeight);
+	}
+	else
+	{
+		PackedPressure = false;
+	}
+
+	if (HalfResolutionProjection)
+	{
+		createCoarseProjection(obstacle, GridWidth, GridHeight);
+	}
+
+	if (SparseTiles)
+	{
+		ActiveTilesAvailable = createActiveTiles(GridWidth, GridHeight);
+		ForceRegion[0] = GridWidth / 2;
+		ForceRegion[1] = GridHeight * 5 / 6;
+		ForceRegion[2] = GridWidth * 9 / 16;
+		ForceRegion[3] = GridHeight;
+	}
+
+	if (AdaptiveTimeStep)
+	{
+		AdaptiveTimeStepAvailable = createVelocityReduction(GridWidth, GridHeight);
+	}
+
+	if (NumJacobiIterations > MaxJacobiIterations) NumJacobiIterations = MaxJacobiIterations;
+	ChebyshevWeights(GridWidth, GridHeight, NumJacobiIterations, ChebyshevSchedule);
+	if (ActiveIterationCount())
+	{
+		MaxAdaptiveIterations = *ActiveIterationCount();
+	}
+	createResidualNorm(GridWidth, GridHeight);
 	ResetState();
+
+	ReportFieldFormats();
 }
 
-void update(Shader& advect, Shader& computeDivergence, Shader& makeGravity, Shader& jacobi, Shader& subtractGradient)
+// With fuseLastIteration the plain Jacobi solver stops one iteration short and
+// leaves it to JacobiSubtractGradient. The residual is then measured one
+// iteration early, which only makes the iteration control slightly conservative.
+void SolvePressure(Programs& programs, bool fuseLastIteration)
 {
-	float velocityDissipation = 0.99f;
-	float densityDissipation = 1.0f;
+	Shader& jacobi = programs.jacobi;
+	Shader& redBlack = programs.redBlack;
+	Shader& extrapolate = programs.extrapolate;
 
-	Advect(advect, velocity.Ping, velocity.Ping, obstacle, velocity.Pong, velocityDissipation);
-	SwapSurfaces(&velocity);
+	switch (WarmStartMode)
+	{
+	case WarmStartZero:
+		ClearSurface(pressure.Ping, 0);
+		break;
+	case WarmStartExtrapolate:
+		Extrapolate(extrapolate, pressure.Ping, previousPressure, pressure.Pong);
+		CopySurface(pressure.Ping, previousPressure);
+		SwapSurfaces(&pressure);
+		break;
+	default:
+		break;
+	}
 
-	Advect(advect, velocity.Ping, density.Ping, obstacle, density.Pong, densityDissipation);
-	SwapSurfaces(&density);
+	if (AdaptiveIterations)
+	{
+		UpdateIterationCount();
+	}
 
-	ComputeDivergence(computeDivergence, velocity.Ping, obstacle, divergence);
+	if (BenchmarkRequested && Solver != PressureSolverRedBlackSOR)
+	{
+		BenchmarkPassed = BenchmarkJacobi(jacobi);
+		BenchmarkRequested = false;
+	}
 
-	AddForce(makeGravity, velocity.Ping, velocity.Pong);
+	switch (Solver)
+	{
+	case PressureSolverMultigrid:
+		MultigridSolve(jacobi, &pressure, divergence, obstacle, obstacleMask, CycleType, NumMultigridCycles);
+		break;
+	case PressureSolverRedBlackSOR:
+		for (int i = 0; i < NumSORSweeps; i++)
+		{
+			RedBlackSOR(redBlack, pressure.Ping, divergence, obstacleMask, CellSize, SOROmega);
+		}
+		break;
+	case PressureSolverConjugateGradient:
+		ConjugateGradientSolve(pressure.Ping, divergence, obstacleMask, CGTolerance, MaxCGIterations);
+		break;
+	case PressureSolverChebyshevJacobi:
+		if (PackedPressure)
+		{
+			PackedJacobiSolve(pressure.Ping, divergence, CellSize, ChebyshevSchedule, NumJacobiIterations);
+			break;
+		}
+		for (int i = 0; i < NumJacobiIterations; i++)
+		{
+			Jacobi(jacobi, pressure.Ping, divergence, obstacleMask, pressure.Pong, CellSize, ChebyshevSchedule[i]);
+			SwapSurfaces(&pressure);
+		}
+		break;
+	case PressureSolverComputeJacobi:
+		ComputeJacobiIterations(NumJacobiIterations);
+		break;
+	default:
+		if (PackedPressure)
+		{
+			PackedJacobiSolve(pressure.Ping, divergence, CellSize, 0, NumJacobiIterations);
+			break;
+		}
+		for (int i = fuseLastIteration ? 1 : 0; i < NumJacobiIterations; i++)
+		{
+			Jacobi(jacobi, pressure.Ping, divergence, obstacleMask, pressure.Pong, CellSize, 1.0f);
+			SwapSurfaces(&pressure);
+		}
+		break;
+	}
+
+	// The result is read back a frame or two later to steer the next iteration counts.
+	if (AdaptiveIterations && ActiveIterationCount())
+	{
+		ResidualNorm(pressure.Ping, divergence, obstacleMask, CellSize);
+		RequestResidualNorm();
+	}
+}
+
+// Replaces SolvePressure and SubtractGradient with a projection on the half-resolution
+// grid, optionally followed by a few fine Jacobi sweeps from zero on what it leaves.
+// The configured solver is not used.
+void ProjectHalfResolution(Programs& programs)
+{
+	CoarseProject(programs.computeDivergence, programs.jacobi, velocity.Ping, obstacleMask, velocity.Pong, CellSize, NumJacobiIterations);
 	SwapSurfaces(&velocity);
+	glViewport(0, 0, GridWidth, GridHeight);
+
+	if (FineCorrectionSweeps > 0)
+	{
+		ComputeDivergence(programs.computeDivergence, velocity.Ping, obstacleMask, divergence, CellSize);
+		ClearSurface(pressure.Ping, 0);
+		for (int i = 0; i < FineCorrectionSweeps; i++)
+		{
+			Jacobi(programs.jacobi, pressure.Ping, divergence, obstacleMask, pressure.Pong, CellSize, 1.0f);
+			SwapSurfaces(&pressure);
+		}
+		SubtractGradient(programs.subtractGradient, velocity.Ping, pressure.Ping, obstacleMask, velocity.Pong);
+		SwapSurfaces(&velocity);
+	}
+}
+
+// Tracer dyes: every scalar field but density is held at 1 inside the jet of
+// gravityField.fs, so the extra fields mark fluid that came from the source.
+static void InjectScalars()
+{
+	glEnable(GL_SCISSOR_TEST);
+	for (int i = 0; i < NumScalarSlabs; i++)
+	{
+		GLboolean write[4];
+		for (int c = 0; c < 4; c++)
+		{
+			int field = 4 * i + c;
+			write[c] = field > 0 && field < NumScalarFields;
+		}
+		Surface s = scalars[i].Ping;
+		glColorMask(write[0], write[1], write[2], write[3]);
+		glScissor(s.Width / 2, s.Height * 5 / 6, s.Width * 9 / 16 - s.Width / 2, s.Height - s.Height * 5 / 6);
+		ClearSurface(s, 1.0f);
+	}
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// All scalar slabs share one back-trace in a single multi-target pass. MacCormack
+// still advects slab by slab, sharing the scratch surfaces.
+static void AdvectScalarFields(Programs& programs, Surface velocity, float dissipation)
+{
+	if (NumScalarSlabs > 1 && Advection == AdvectionSemiLagrangian)
+	{
+		AdvectScalars(velocity, obstacle, scalars, NumScalarSlabs, TimeStep, dissipation);
+		return;
+	}
+	for (int i = 0; i < NumScalarSlabs; i++)
+	{
+		AdvectField(programs, velocity, &scalars[i], densityScratch, dissipation, ScalarSolidValue, true);
+	}
+}
+
+static void Step(Programs& programs)
+{
+	float velocityDissipation = powf(0.99f, TimeStep / ReferenceTimeStep);
+	float densityDissipation = 1.0f;
 
-	//ClearSurface(pressure.Ping, 0);
+	glViewport(0, 0, GridWidth, GridHeight);
 
-	int numJacobiIterations = 20;
-	for (int i = 0; i < numJacobiIterations; i++)
+	if (SparseTiles && ActiveTilesAvailable)
 	{
-		Jacobi(jacobi, pressure.Ping, divergence, obstacle, pressure.Pong);
+		UpdateActiveTiles(velocity.Ping, density.Ping, ActivityThreshold, ForceRegion);
+	}
+
+	if (NumScalarFields > 1)
+	{
+		InjectScalars();
+	}
+
+	if (FusedPasses)
+	{
+		// A finer density grid cannot share the multi-target FBO and is advected on its
+		// own, and so is MacCormack advection, after velocity as in the separate passes.
+		if (DensityScale == 1 && Advection == AdvectionSemiLagrangian && NumScalarSlabs == 1)
+		{
+			AdvectFused(programs.advectFused, velocity.Ping, density.Ping, obstacle, velocity.Pong, density.Pong, velocityDissipation, densityDissipation);
+			SwapSurfaces(&velocity);
+			SwapSurfaces(&density);
+		}
+		else
+		{
+			AdvectField(programs, velocity.Ping, &velocity, velocityScratch, velocityDissipation, VelocitySolidValue, false);
+			AdvectScalarFields(programs, velocity.Ping, densityDissipation);
+		}
+
+		AddForceAndDivergence(programs.forceDivergence, velocity.Ping, obstacleMask, velocity.Pong, divergence);
+		SwapSurfaces(&velocity);
+	}
+	else
+	{
+		AdvectField(programs, velocity.Ping, &velocity, velocityScratch, velocityDissipation, VelocitySolidValue, false);
+		AdvectScalarFields(programs, velocity.Ping, densityDissipation);
+
+		ComputeDivergence(programs.computeDivergence, velocity.Ping, obstacleMask, divergence, CellSize);
+
+		AddForce(programs.makeGravity, velocity.Ping, velocity.Pong);
+		SwapSurfaces(&velocity);
+	}
+
+	if (HalfResolutionProjection)
+	{
+		ProjectHalfResolution(programs);
+		return;
+	}
+
+	bool fuseLastIteration = FusedPasses && Solver == PressureSolverJacobi && !PackedPressure && NumJacobiIterations > 0;
+	SolvePressure(programs, fuseLastIteration);
+
+	if (fuseLastIteration)
+	{
+		JacobiSubtractGradient(programs.jacobiSubtractGradient, velocity.Ping, pressure.Ping, divergence, obstacleMask, velocity.Pong, pressure.Pong);
+		SwapSurfaces(&velocity);
 		SwapSurfaces(&pressure);
 	}
+	else
+	{
+		SubtractGradient(programs.subtractGradient, velocity.Ping, pressure.Ping, obstacleMask, velocity.Pong);
+		SwapSurfaces(&velocity);
+	}
+}
 
-	SubtractGradient(subtractGradient, velocity.Ping, pressure.Ping, obstacle, velocity.Pong);
-	SwapSurfaces(&velocity);
+// Advances the simulation by FrameTime. Until the first max |u| arrives, and if the
+// substep budget runs out, the CFL bound is exceeded rather than the frame shortened;
+// semi-Lagrangian advection stays stable, only less accurate.
+void update(Programs& programs)
+{
+	StepCount++;
+
+	if (!AdaptiveTimeStepAvailable)
+	{
+		TimeStep = FrameTime;
+		Step(programs);
+		return;
+	}
+
+	ReadMaxVelocity(&MaxSpeed);
+	int substeps = (int)ceilf(MaxSpeed * FrameTime / MaxCFL);
+	if (substeps < 1) substeps = 1;
+	if (substeps > MaxSubsteps) substeps = MaxSubsteps;
+
+	TimeStep = FrameTime / substeps;
+	for (int i = 0; i < substeps; i++)
+	{
+		Step(programs);
+	}
+
+	RequestMaxVelocity(velocity.Ping);
 }
 
-void render(Shader& visualizeProgram)
+// Draws density interpolated between previousDensity (alpha 0) and the current state (alpha 1),
+// or with --show-scalar the one scalar field, which has no previous state to blend with.
+void render(Shader& visualizeProgram, float alpha)
 {
 	visualizeProgram.Use();
 
 	GLint fillColor = glGetUniformLocation(visualizeProgram.Program, "FillColor");
 	GLint scale = glGetUniformLocation(visualizeProgram.Program, "Scale");
+	GLint sourceSize = glGetUniformLocation(visualizeProgram.Program, "SourceSize");
+	GLint bicubic = glGetUniformLocation(visualizeProgram.Program, "Bicubic");
+	GLint alphaLoc = glGetUniformLocation(visualizeProgram.Program, "Alpha");
+	GLint previousSampler = glGetUniformLocation(visualizeProgram.Program, "PreviousSampler");
+	GLint channel = glGetUniformLocation(visualizeProgram.Program, "Channel");
+
+	Surface shown = density.Ping;
+	Surface previous = FreeRunning ? density.Ping : previousDensity;
+	if (ShownScalar >= 0)
+	{
+		shown = previous = scalars[ShownScalar / 4].Ping;
+	}
 
 	glViewport(0, 0, WIDTH, HEIGHT);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glActiveTexture(GL_TEXTURE0);
-	//glBindTexture(GL_TEXTURE_2D, velocity.Pong.TextureHandle);
-	glBindTexture(GL_TEXTURE_2D, density.Pong.TextureHandle);
-	//glBindTexture(GL_TEXTURE_2D, pressure.Pong.TextureHandle);
+	//glBindTexture(GL_TEXTURE_2D, velocity.Ping.TextureHandle);
+	glBindTexture(GL_TEXTURE_2D, shown.TextureHandle);
+	//glBindTexture(GL_TEXTURE_2D, pressure.Ping.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, previous.TextureHandle);
+	glUniform1i(previousSampler, 1);
+	glUniform1i(channel, (ShownScalar >= 0) ? ShownScalar % 4 : -1);
+	glUniform1f(alphaLoc, alpha);
 	glUniform3f(fillColor, 1.0, 0.0, 0.0);
 	glUniform2f(scale, 1.0f / WIDTH, 1.0f / HEIGHT);
+	glUniform2f(sourceSize, (float)shown.Width, (float)shown.Height);
+	glUniform1i(bicubic, BicubicUpsampling);
 	glBindVertexArray(QuadVao);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	glDisable(GL_BLEND);
 }
 
-int main()
+static void WriteDensity(const void* data, int width, int height, int numComponents, int frame, void* user)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/density_%05d.pfm", (const char*)user, frame);
+	QueueFieldPfm(path, (const float*)data, ExportFinishing);
+}
+
+static void RecordField(const void* data, int width, int height, int numComponents, int frame, void* user)
+{
+	QueueSequenceField((int)(intptr_t)user, frame, (const uint16_t*)data, ExportFinishing);
+}
+
+static void CacheDensity(const void* data, int width, int height, int numComponents, int frame, void* user)
+{
+	AppendCachedFrame((const uint16_t*)data, frame, ExportFinishing);
+}
+
+static void createExport()
+{
+	if (OutputDirectory)
+	{
+		densityExport = createReadbackRing(ExportSlots, density.Ping.Width, density.Ping.Height, 1, GL_FLOAT, WriteDensity, (void*)OutputDirectory);
+		startFieldWriter(ExportSlots, density.Ping.Width, density.Ping.Height, 1);
+	}
+
+	if (RecordPath)
+	{
+		SequenceHeader header = {};
+		header.GridWidth = GridWidth;
+		header.GridHeight = GridHeight;
+		header.FrameTime = FrameTime;
+		header.NumFields = 2;
+		header.Fields[0] = { "density", density.Ping.Width, density.Ping.Height, 1 };
+		header.Fields[1] = { "velocity", velocity.Ping.Width, velocity.Ping.Height, 2 };
+		if (openSequenceWriter(RecordPath, header))
+		{
+			recordRings[0] = createReadbackRing(ExportSlots, density.Ping.Width, density.Ping.Height, 1, GL_HALF_FLOAT, RecordField, (void*)0);
+			recordRings[1] = createReadbackRing(ExportSlots, velocity.Ping.Width, velocity.Ping.Height, 2, GL_HALF_FLOAT, RecordField, (void*)1);
+		}
+		else
+		{
+			RecordPath = nullptr;
+		}
+	}
+
+	if (CachePath)
+	{
+		if (openTileCacheWriter(CachePath, density.Ping.Width, density.Ping.Height, 1, CacheThreshold))
+		{
+			densityCache = createReadbackRing(ExportSlots, density.Ping.Width, density.Ping.Height, 1, GL_HALF_FLOAT, CacheDensity, nullptr);
+		}
+		else
+		{
+			CachePath = nullptr;
+		}
+	}
+}
+
+// Every surface the next update reads before writing it.
+static int CheckpointSurfaces(const char** names, Surface* surfaces)
+{
+	static const char* slabNames[MaxScalarSlabs] = { "scalars0", "scalars1", "scalars2", "scalars3" };
+	int n = 0;
+	names[n] = "velocity"; surfaces[n++] = velocity.Ping;
+	for (int i = 0; i < NumScalarSlabs; i++)
+	{
+		names[n] = slabNames[i]; surfaces[n++] = scalars[i].Ping;
+	}
+	names[n] = "pressure"; surfaces[n++] = pressure.Ping;
+	if (WarmStartMode == WarmStartExtrapolate)
+	{
+		names[n] = "previous pressure"; surfaces[n++] = previousPressure;
+	}
+	names[n] = "obstacle"; surfaces[n++] = obstacle;
+	names[n] = "obstacle mask"; surfaces[n++] = obstacleMask;
+	if (SparseTiles && ActiveTilesAvailable)
+	{
+		names[n] = "tile activity"; surfaces[n++] = ActiveTilesHistory();
+	}
+	return n;
+}
+
+// Flags that change the simulation's result, stored in CheckpointHeader::Options.
+static uint32_t SimulationOptions()
+{
+	uint32_t options = 0;
+	if (AdaptiveIterations) options |= 1u << 0;
+	if (AdaptiveTimeStep) options |= 1u << 1;
+	if (PackedPressure) options |= 1u << 2;
+	if (HalfResolutionProjection) options |= 1u << 3;
+	if (SparseTiles) options |= 1u << 4;
+	if (FusedPasses) options |= 1u << 5;
+	return options;
+}
+
+static void SaveSimulationCheckpoint()
+{
+	const char* names[MaxCheckpointFields];
+	Surface surfaces[MaxCheckpointFields];
+	int n = CheckpointSurfaces(names, surfaces);
+
+	CheckpointHeader state = {};
+	state.GridWidth = GridWidth;
+	state.GridHeight = GridHeight;
+	state.DensityScale = DensityScale;
+	state.NumScalarFields = NumScalarFields;
+	state.Step = StepCount;
+	state.MaxSpeed = MaxSpeed;
+	state.Solver = Solver;
+	state.Advection = Advection;
+	state.CycleType = CycleType;
+	state.WarmStart = WarmStartMode;
+	state.IterationCount = ActiveIterationCount() ? *ActiveIterationCount() : 0;
+	state.Options = SimulationOptions();
+	SaveCheckpoint(CheckpointPath, state, names, surfaces, n);
+}
+
+// Must run after initialize(), which allocates the surfaces with the same grid options.
+static bool RestoreSimulation(const char* path)
+{
+	const char* names[MaxCheckpointFields];
+	Surface surfaces[MaxCheckpointFields];
+	int n = CheckpointSurfaces(names, surfaces);
+
+	CheckpointHeader state;
+	if (!RestoreCheckpoint(path, names, surfaces, n, &state))
+		return false;
+	if (state.GridWidth != GridWidth || state.GridHeight != GridHeight || state.DensityScale != DensityScale || state.NumScalarFields != NumScalarFields)
+	{
+		std::cout << "Checkpoint " << path << " was written with different grid options." << std::endl;
+		return false;
+	}
+	if (state.Solver != Solver || state.Advection != Advection || state.CycleType != CycleType
+		|| state.WarmStart != WarmStartMode || state.Options != SimulationOptions())
+	{
+		std::cout << "Checkpoint " << path << " was written with different solver or advection options." << std::endl;
+		return false;
+	}
+
+	StepCount = state.Step;
+	MaxSpeed = state.MaxSpeed;
+	int* count = ActiveIterationCount();
+	if (count && state.IterationCount > 0)
+	{
+		*count = (state.IterationCount < MaxAdaptiveIterations) ? state.IterationCount : MaxAdaptiveIterations;
+		if (Solver == PressureSolverChebyshevJacobi)
+		{
+			ChebyshevWeights(GridWidth, GridHeight, *count, ChebyshevSchedule);
+		}
+	}
+	if (!FreeRunning)
+	{
+		CopySurface(density.Ping, previousDensity);
+	}
+	std::cout << "Resumed from " << path << " at step " << StepCount << "." << std::endl;
+	return true;
+}
+
+static void ExportStep(int step, bool last)
+{
+	if (OutputDirectory)
+	{
+		PollReadbacks(densityExport);
+		if (last)
+		{
+			// The final frame is never dropped.
+			DrainReadbacks(densityExport);
+		}
+		if (last || (OutputInterval > 0 && step % OutputInterval == 0))
+		{
+			QueueReadback(densityExport, density.Ping, step);
+		}
+	}
+
+	if (CachePath)
+	{
+		PollReadbacks(densityCache);
+		if (last)
+		{
+			DrainReadbacks(densityCache);
+		}
+		if (last || step % CacheInterval == 0)
+		{
+			QueueReadback(densityCache, density.Ping, step);
+		}
+	}
+
+	if (CheckpointPath)
+	{
+		PollCheckpoint();
+		if (CheckpointInterval > 0 && step % CheckpointInterval == 0)
+		{
+			SaveSimulationCheckpoint();
+		}
+	}
+
+	if (RecordPath)
+	{
+		PollReadbackGroup(recordRings, 2);
+		if (last)
+		{
+			DrainReadbackGroup(recordRings, 2);
+		}
+		if (last || step % RecordInterval == 0)
+		{
+			Surface sources[] = { density.Ping, velocity.Ping };
+			QueueReadbackGroup(recordRings, sources, 2, step);
+		}
+	}
+}
+
+// Hands every outstanding readback to its consumer, closes the recording and frees
+// the readback rings.
+static void FinishExport()
+{
+	// The frames still in flight, the last one among them, wait for the writers.
+	ExportFinishing = true;
+	if (OutputDirectory)
+	{
+		DrainReadbacks(densityExport);
+		stopFieldWriter();
+		if (densityExport.Dropped > 0)
+		{
+			std::cout << "Export: " << densityExport.Dropped << " readbacks dropped." << std::endl;
+		}
+		destroyReadbackRing(densityExport);
+	}
+	if (RecordPath)
+	{
+		DrainReadbackGroup(recordRings, 2);
+		closeSequenceWriter();
+		destroyReadbackRing(recordRings[0]);
+		destroyReadbackRing(recordRings[1]);
+	}
+	if (CachePath)
+	{
+		DrainReadbacks(densityCache);
+		closeTileCacheWriter();
+		if (densityCache.Dropped > 0)
+		{
+			std::cout << "History cache: " << densityCache.Dropped << " readbacks dropped." << std::endl;
+		}
+		destroyReadbackRing(densityCache);
+	}
+	if (CheckpointPath)
+	{
+		FinishCheckpoint();
+	}
+}
+
+static void RunHeadless(Programs& programs)
+{
+	auto start = std::chrono::steady_clock::now();
+	int startStep = StepCount;
+	while (StepCount < HeadlessSteps)
+	{
+		update(programs);
+		ExportStep(StepCount, StepCount == HeadlessSteps);
+	}
+	FinishExport();
+	glFinish();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	int steps = StepCount - startStep;
+	std::cout << steps << " steps in " << seconds << " s, " << steps / seconds << " steps/s" << std::endl;
+}
+
+int main(int argc, char* argv[])
 {
-	// Init GLFW
-	glfwInit();
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--grid") == 0 && i + 2 < argc)
+		{
+			GridWidth = atoi(argv[++i]);
+			GridHeight = atoi(argv[++i]);
+			if (GridWidth < MinGridSize || GridHeight < MinGridSize || GridWidth > MaxGridSize || GridHeight > MaxGridSize)
+			{
+				std::cout << "--grid needs a width and height between " << MinGridSize << " and " << MaxGridSize << "." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--density-scale") == 0 && i + 1 < argc)
+		{
+			DensityScale = atoi(argv[++i]);
+			if (DensityScale < 1) DensityScale = 1;
+		}
+		else if (strcmp(argv[i], "--scalars") == 0 && i + 1 < argc)
+		{
+			NumScalarFields = atoi(argv[++i]);
+			if (NumScalarFields < 1) NumScalarFields = 1;
+			if (NumScalarFields > 4 * MaxScalarSlabs) NumScalarFields = 4 * MaxScalarSlabs;
+		}
+		else if (strcmp(argv[i], "--show-scalar") == 0 && i + 1 < argc)
+		{
+			ShownScalar = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--cfl") == 0 && i + 1 < argc)
+		{
+			MaxCFL = (float)atof(argv[++i]);
+			AdaptiveTimeStep = MaxCFL > 0;
+		}
+		else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc)
+		{
+			SimulationRate = atof(argv[++i]);
+			if (SimulationRate <= 0) SimulationRate = 60.0;
+		}
+		else if (strcmp(argv[i], "--free-run") == 0)
+		{
+			FreeRunning = true;
+		}
+		else if (strcmp(argv[i], "--headless") == 0)
+		{
+			Headless = true;
+			FreeRunning = true;
+		}
+		else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+		{
+			HeadlessSteps = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+		{
+			OutputDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--output-every") == 0 && i + 1 < argc)
+		{
+			OutputInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+		{
+			RecordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--record-every") == 0 && i + 1 < argc)
+		{
+			RecordInterval = atoi(argv[++i]);
+			if (RecordInterval < 1) RecordInterval = 1;
+		}
+		else if (strcmp(argv[i], "--checkpoint") == 0 && i + 2 < argc)
+		{
+			CheckpointPath = argv[++i];
+			CheckpointInterval = atoi(argv[++i]);
+			if (CheckpointInterval <= 0)
+			{
+				std::cout << "--checkpoint needs an interval of at least one step." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+		{
+			ResumePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+		{
+			CachePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--cache-every") == 0 && i + 1 < argc)
+		{
+			CacheInterval = atoi(argv[++i]);
+			if (CacheInterval < 1) CacheInterval = 1;
+		}
+		else if (strcmp(argv[i], "--cache-threshold") == 0 && i + 1 < argc)
+		{
+			CacheThreshold = (float)atof(argv[++i]);
+			if (CacheThreshold < 0)
+			{
+				std::cout << "--cache-threshold cannot be negative." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--verify-cache") == 0 && i + 1 < argc)
+		{
+			return VerifyTileCache(argv[++i]) ? 0 : 1;
+		}
+		else if (strcmp(argv[i], "--solver") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			int count = sizeof(SolverNames) / sizeof(SolverNames[0]);
+			int found = -1;
+			for (int k = 0; k < count; k++)
+			{
+				if (strcmp(name, SolverNames[k]) == 0) found = k;
+			}
+			if (found < 0)
+			{
+				std::cout << "Unknown solver " << name << "; expected jacobi, multigrid, sor, cg, chebyshev or compute." << std::endl;
+				return 1;
+			}
+			Solver = (PressureSolver)found;
+		}
+		else if (strcmp(argv[i], "--advection") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "semi") == 0)
+			{
+				Advection = AdvectionSemiLagrangian;
+			}
+			else if (strcmp(name, "maccormack") == 0)
+			{
+				Advection = AdvectionMacCormack;
+			}
+			else
+			{
+				std::cout << "Unknown advection scheme " << name << "; expected semi or maccormack." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--sor-sweeps") == 0 && i + 1 < argc)
+		{
+			NumSORSweeps = atoi(argv[++i]);
+			if (NumSORSweeps < 1) NumSORSweeps = 1;
+		}
+		else if (strcmp(argv[i], "--sor-omega") == 0 && i + 1 < argc)
+		{
+			// SOR only converges for 0 < omega < 2.
+			SOROmega = (float)atof(argv[++i]);
+			if (SOROmega <= 0.0f || SOROmega >= 2.0f)
+			{
+				std::cout << "--sor-omega must lie between 0 and 2." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--cycle") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			if (strcmp(name, "v") == 0)
+			{
+				CycleType = MultigridVCycle;
+			}
+			else if (strcmp(name, "w") == 0)
+			{
+				CycleType = MultigridWCycle;
+			}
+			else
+			{
+				std::cout << "Unknown cycle " << name << "; expected v or w." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--jacobi-k") == 0 && i + 1 < argc)
+		{
+			IterationsPerDispatch = atoi(argv[++i]);
+			if (IterationsPerDispatch < 1 || IterationsPerDispatch > MaxIterationsPerDispatch)
+			{
+				std::cout << "--jacobi-k needs 1 to " << MaxIterationsPerDispatch << " sweeps per dispatch." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--benchmark-jacobi") == 0 && i + 1 < argc)
+		{
+			BenchmarkStep = atoi(argv[++i]);
+			if (BenchmarkStep < 1)
+			{
+				std::cout << "--benchmark-jacobi needs an update of at least 1." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--warm-start") == 0 && i + 1 < argc)
+		{
+			const char* name = argv[++i];
+			int count = sizeof(WarmStartNames) / sizeof(WarmStartNames[0]);
+			int found = -1;
+			for (int k = 0; k < count; k++)
+			{
+				if (strcmp(name, WarmStartNames[k]) == 0) found = k;
+			}
+			if (found < 0)
+			{
+				std::cout << "Unknown warm start " << name << "; expected zero, previous or extrapolate." << std::endl;
+				return 1;
+			}
+			WarmStartMode = (WarmStart)found;
+		}
+		else if (strcmp(argv[i], "--adaptive") == 0)
+		{
+			AdaptiveIterations = true;
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+		{
+			ResidualTolerance = (float)atof(argv[++i]);
+			if (ResidualTolerance <= 0.0f)
+			{
+				std::cout << "--tolerance must be positive." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--half-res-projection") == 0)
+		{
+			HalfResolutionProjection = true;
+		}
+		else if (strcmp(argv[i], "--fine-sweeps") == 0 && i + 1 < argc)
+		{
+			FineCorrectionSweeps = atoi(argv[++i]);
+			if (FineCorrectionSweeps < 0) FineCorrectionSweeps = 0;
+		}
+		else if (strcmp(argv[i], "--packed-pressure") == 0)
+		{
+			PackedPressure = true;
+		}
+		else if (strcmp(argv[i], "--sparse-tiles") == 0)
+		{
+			SparseTiles = true;
+		}
+		else if (strcmp(argv[i], "--fused") == 0)
+		{
+			FusedPasses = true;
+		}
+		else if (strcmp(argv[i], "--split-boundary") == 0)
+		{
+			SplitBoundaryPasses = true;
+		}
+		else if (strcmp(argv[i], "--cull-solid") == 0)
+		{
+			CullSolidCells = true;
+		}
+		else if (strcmp(argv[i], "--bicubic") == 0)
+		{
+			BicubicUpsampling = true;
+		}
+	}
 
-	// Set all the required options for GLFW
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	if (ShownScalar >= NumScalarFields)
+	{
+		std::cout << "--show-scalar needs a field below --scalars " << NumScalarFields << "." << std::endl;
+		return 1;
+	}
+	if (BenchmarkStep > 0 && Solver == PressureSolverRedBlackSOR)
+	{
+		std::cout << "--benchmark-jacobi needs a solver other than sor." << std::endl;
+		return 1;
+	}
 
-	// Create a GLFWwindow object that we can use for GLFW's functions
-	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "Fluid simulation", nullptr, nullptr);
-	glfwMakeContextCurrent(window);
+	GLFWwindow* window = nullptr;
+	if (Headless)
+	{
+		// Compute shaders need 4.3; the fragment solvers run on 3.3.
+		if (!createHeadlessContext(4, 3) && !createHeadlessContext(3, 3))
+			return 1;
+	}
+	else
+	{
+		// Init GLFW
+		glfwInit();
 
-	// Set the required callback functions
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
+		// Set all the required options for GLFW
+		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
-	// GLFW Options
-//	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// Create a GLFWwindow object that we can use for GLFW's functions
+		window = glfwCreateWindow(WIDTH, HEIGHT, "Fluid simulation", nullptr, nullptr);
+		glfwMakeContextCurrent(window);
+
+		// Set the required callback functions
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
+
+		// GLFW Options
+	//	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	// Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
 	glewExperimental = GL_TRUE;
@@ -336,14 +2065,63 @@ int main()
 	// Define the viewport dimensions
 	glViewport(0, 0, WIDTH, HEIGHT);
 
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	long long densityWidth = (long long)GridWidth * DensityScale, densityHeight = (long long)GridHeight * DensityScale;
+	if (densityWidth > maxTextureSize || densityHeight > maxTextureSize)
+	{
+		std::cout << "The " << densityWidth << "x" << densityHeight
+			<< " density grid exceeds the texture size limit of " << maxTextureSize << "." << std::endl;
+		return 1;
+	}
+
 	initialize();
 
+	Programs programs = {
+		Shader("defaultVS.vs", "advect.fs"),
+		Shader("defaultVS.vs", "computeDivergence.fs"),
+		Shader("defaultVS.vs", "gravityField.fs"),
+		Shader("defaultVS.vs", "jacobi.fs"),
+		Shader("defaultVS.vs", "redBlackSOR.fs"),
+		Shader("defaultVS.vs", "extrapolate.fs"),
+		Shader("defaultVS.vs", "subtractGradient.fs"),
+		Shader("defaultVS.vs", "advectFused.fs"),
+		Shader("defaultVS.vs", "forceDivergence.fs"),
+		Shader("defaultVS.vs", "jacobiSubtractGradient.fs"),
+		Shader("defaultVS.vs", "macCormack.fs"),
+	};
+
+	if (ResumePath && !RestoreSimulation(ResumePath))
+		return 1;
+
+	if (BenchmarkStep > 0)
+	{
+		while (StepCount < BenchmarkStep - 1)
+		{
+			update(programs);
+		}
+		BenchmarkRequested = true;
+		update(programs);
+		glFinish();
+		if (Headless)
+			destroyHeadlessContext();
+		else
+			glfwTerminate();
+		return BenchmarkPassed ? 0 : 1;
+	}
+
+	createExport();
+
+	if (Headless)
+	{
+		RunHeadless(programs);
+		destroyHeadlessContext();
+		return 0;
+	}
+
 	Shader vizualizeProgram("defaultVS.vs", "visualize.fs");
-	Shader advect("defaultVS.vs", "advect.fs");
-	Shader computeDivergence("defaultVS.vs", "computeDivergence.fs");
-	Shader makeGravity("defaultVS.vs", "gravityField.fs");
-	Shader jacobi("defaultVS.vs", "jacobi.fs");
-	Shader subtractGradient("defaultVS.vs", "subtractGradient.fs");
+	glfwSwapInterval(FreeRunning ? 0 : 1);
+	FixedStepScheduler scheduler = createScheduler(SimulationRate, MaxCatchUpTicks, glfwGetTime());
 
 	// Game loop
 	while (!glfwWindowShouldClose(window))
@@ -355,16 +2133,25 @@ int main()
 		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
 		glfwPollEvents();
 
-		update(advect, computeDivergence, makeGravity, jacobi, subtractGradient);
-		render(vizualizeProgram);
-
-		// Swap the screen buffers
+		int ticks = FreeRunning ? 1 : ScheduleTicks(&scheduler, glfwGetTime());
+		for (int i = 0; i < ticks; i++)
+		{
+			if (!FreeRunning)
+			{
+				CopySurface(density.Ping, previousDensity);
+			}
+			update(programs);
+			ExportStep(StepCount, false);
+		}
+		render(vizualizeProgram, FreeRunning ? 1.0f : InterpolationFactor(&scheduler));
+
+		// Swap the screen buffers; with vsync this also paces the loop
 		glfwSwapBuffers(window);
-
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
 		lastFrame = currentFrame;
 	}
 
+	FinishExport();
+
 	// Terminate GLFW, clearing any resources allocated by GLFW.
 	glfwTerminate();
 
@@ -376,6 +2163,8 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
+	if (key == GLFW_KEY_B && action == GLFW_PRESS)
+		BenchmarkRequested = true;
 	if (key >= 0 && key < 1024)
 	{
 		if (action == GLFW_PRESS)
@@ -25,6 +25,8 @@ typedef struct Surface_ {
 	GLuint FboHandle;
 	GLuint TextureHandle;
 	int NumComponents;
+	int Width;
+	int Height;
 } Surface;
 
 typedef struct PingPongTexture_ {
@@ -36,3 +38,31 @@ typedef struct Vector2_ {
 	int X;
 	int Y;
 } Vector2;
+
+typedef enum PressureSolver_ {
+	PressureSolverJacobi,
+	PressureSolverMultigrid,
+	PressureSolverRedBlackSOR,
+	PressureSolverConjugateGradient,
+	PressureSolverChebyshevJacobi,
+	PressureSolverComputeJacobi
+} PressureSolver;
+
+typedef enum AdvectionScheme_ {
+	AdvectionSemiLagrangian,
+	AdvectionMacCormack
+} AdvectionScheme;
+
+typedef enum WarmStart_ {
+	WarmStartZero,
+	WarmStartPrevious,
+	WarmStartExtrapolate
+} WarmStart;
+
+// Shared simulation passes, defined in FluidSimulation.cpp
+void ResetState();
+void SwapSurfaces(PingPongTexture* slab);
+void ClearSurface(Surface s, float v);
+void CopySurface(Surface source, Surface dest);
+void ComputeDivergence(Shader& computeDivergence, Surface velocity, Surface obstacleMask, Surface dest, float cellSize);
+void Jacobi(Shader& jacobi, Surface pressure, Surface divergence, Surface obstacleMask, Surface dest, float cellSize, float omega);
@@ -0,0 +1,131 @@
+#include "stdafx.h"
+#include "HeadlessContext.h"
+
+// Builds outside Visual Studio use EGL whenever its headers are installed; they then
+// link with -lEGL. The Visual Studio project defines FLUID_HEADLESS_EGL and links
+// libEGL.lib when built with /p:FluidHeadlessEGL=true.
+#if !defined(FLUID_HEADLESS_EGL) && !defined(_MSC_VER) && defined(__has_include)
+#if __has_include(<EGL/egl.h>)
+#define FLUID_HEADLESS_EGL
+#endif
+#endif
+
+static GLFWwindow* window;
+
+#ifdef FLUID_HEADLESS_EGL
+#include <cstring>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static bool createEglContext(int major, int minor)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+	{
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	}
+	if (display == EGL_NO_DISPLAY)
+	{
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0))
+	{
+		std::cout << "No EGL display." << std::endl;
+		display = EGL_NO_DISPLAY;
+		return false;
+	}
+
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+	{
+		std::cout << "EGL_KHR_surfaceless_context not supported." << std::endl;
+		return false;
+	}
+
+	EGLint configAttributes[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	eglBindAPI(EGL_OPENGL_API);
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+	{
+		std::cout << "No EGL config for desktop OpenGL." << std::endl;
+		return false;
+	}
+
+	EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cout << "Could not create an OpenGL " << major << "." << minor << " EGL context." << std::endl;
+		if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+		context = EGL_NO_CONTEXT;
+		return false;
+	}
+	return true;
+}
+
+static void destroyEglContext()
+{
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	if (display != EGL_NO_DISPLAY) eglTerminate(display);
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+}
+#endif
+
+static bool createHiddenWindow(int major, int minor)
+{
+	if (!glfwInit())
+	{
+		std::cout << "GLFW could not be initialized." << std::endl;
+		return false;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+
+	window = glfwCreateWindow(1, 1, "Fluid simulation", nullptr, nullptr);
+	if (!window)
+	{
+		std::cout << "Could not create an OpenGL " << major << "." << minor << " context." << std::endl;
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	return true;
+}
+
+// EGL first; the hidden window needs a display server and is only the fallback.
+bool createHeadlessContext(int major, int minor)
+{
+#ifdef FLUID_HEADLESS_EGL
+	if (createEglContext(major, minor))
+		return true;
+	destroyEglContext();
+	std::cout << "Falling back to a hidden GLFW window." << std::endl;
+#endif
+	return createHiddenWindow(major, minor);
+}
+
+void destroyHeadlessContext()
+{
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		window = nullptr;
+	}
+#ifdef FLUID_HEADLESS_EGL
+	destroyEglContext();
+#endif
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+
+// An OpenGL context with no visible window, for batch runs. Where EGL is built in
+// it is an EGL surfaceless context (Mesa llvmpipe included), which needs GLEW built
+// with GLEW_EGL; a hidden GLFW window is used when EGL is missing or fails.
+// Either way there is no default framebuffer to present, only FBOs.
+bool createHeadlessContext(int major, int minor);
+void destroyHeadlessContext();
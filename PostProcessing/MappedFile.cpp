@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MapFile(const char* path, MappedFile* mapped)
+{
+	mapped->Data = nullptr;
+	mapped->Mapping = nullptr;
+	mapped->File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mapped->File == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped->File, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(mapped->File);
+		return false;
+	}
+	mapped->Size = (size_t)size.QuadPart;
+
+	mapped->Mapping = CreateFileMappingA(mapped->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapped->Mapping)
+	{
+		mapped->Data = (const uint8_t*)MapViewOfFile(mapped->Mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!mapped->Data)
+	{
+		if (mapped->Mapping) CloseHandle(mapped->Mapping);
+		CloseHandle(mapped->File);
+		return false;
+	}
+	return true;
+}
+
+void UnmapFile(MappedFile* mapped)
+{
+	UnmapViewOfFile(mapped->Data);
+	CloseHandle(mapped->Mapping);
+	CloseHandle(mapped->File);
+	mapped->Data = nullptr;
+}
+
+#else
+
+bool MapFile(const char* path, MappedFile* mapped)
+{
+	mapped->Data = nullptr;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	mapped->Size = (size_t)info.st_size;
+
+	void* data = mmap(nullptr, mapped->Size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	mapped->Data = (const uint8_t*)data;
+	return true;
+}
+
+void UnmapFile(MappedFile* mapped)
+{
+	munmap((void*)mapped->Data, mapped->Size);
+	mapped->Data = nullptr;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include "stdafx.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// A read-only memory mapping of a whole file.
+typedef struct MappedFile_ {
+	const uint8_t* Data;
+	size_t Size;
+#ifdef _WIN32
+	HANDLE File;
+	HANDLE Mapping;
+#endif
+} MappedFile;
+
+bool MapFile(const char* path, MappedFile* mapped);
+void UnmapFile(MappedFile* mapped);
@@ -0,0 +1,173 @@
+#include "stdafx.h"
+#include "Multigrid.h"
+#include "TextureHandler.h"
+#include "Obstacle.h"
+
+#define MaxLevels (12)
+#define MinLevelSize (8)
+#define CoarsestSmoothingSteps (16)
+#define SmoothingWeight (0.8f)
+
+static MultigridLevel levels[MaxLevels];
+static int numLevels;
+static GLuint residualProgram, restrictProgram, restrictObstaclesProgram, prolongateProgram;
+
+static void SetViewport(Surface s)
+{
+	glViewport(0, 0, s.Width, s.Height);
+}
+
+static void Residual(MultigridLevel& level, Surface dest)
+{
+	GLuint p = residualProgram;
+	glUseProgram(p);
+
+	GLint inverseCellSizeSquared = glGetUniformLocation(p, "InverseCellSizeSquared");
+	GLint dSampler = glGetUniformLocation(p, "Divergence");
+	GLint oSampler = glGetUniformLocation(p, "ObstacleMask");
+
+	glUniform1f(inverseCellSizeSquared, 1.0f / (level.CellSize * level.CellSize));
+	glUniform1i(dSampler, 1);
+	glUniform1i(oSampler, 2);
+
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, level.Pressure.Ping.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, level.Divergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, level.Mask.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	ResetState();
+}
+
+static void Restrict(GLuint p, Surface source, Surface dest)
+{
+	glUseProgram(p);
+
+	GLint sourceSize = glGetUniformLocation(p, "SourceSize");
+	glUniform2i(sourceSize, source.Width, source.Height);
+
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	ResetState();
+}
+
+static void Prolongate(Surface pressure, Surface correction, Surface dest)
+{
+	GLuint p = prolongateProgram;
+	glUseProgram(p);
+
+	GLint coarseInverseSize = glGetUniformLocation(p, "CoarseInverseSize");
+	GLint cSampler = glGetUniformLocation(p, "Correction");
+	glUniform2f(coarseInverseSize, 0.5f / correction.Width, 0.5f / correction.Height);
+	glUniform1i(cSampler, 1);
+
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, correction.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	ResetState();
+}
+
+static void Smooth(Shader& jacobi, MultigridLevel& level, int numIterations)
+{
+	SetViewport(level.Pressure.Ping);
+	for (int i = 0; i < numIterations; i++)
+	{
+		Jacobi(jacobi, level.Pressure.Ping, level.Divergence, level.Mask, level.Pressure.Pong, level.CellSize, SmoothingWeight);
+		SwapSurfaces(&level.Pressure);
+	}
+}
+
+static void Cycle(Shader& jacobi, int l, MultigridCycle cycle)
+{
+	MultigridLevel& level = levels[l];
+
+	if (l == numLevels - 1)
+	{
+		Smooth(jacobi, level, CoarsestSmoothingSteps);
+		return;
+	}
+
+	MultigridLevel& coarse = levels[l + 1];
+	Smooth(jacobi, level, PreSmoothingSteps);
+
+	// The residual goes to the Pong half, which the next smoothing step overwrites anyway:
+	Residual(level, level.Pressure.Pong);
+	Restrict(restrictProgram, level.Pressure.Pong, coarse.Divergence);
+	ClearSurface(coarse.Pressure.Ping, 0);
+
+	int numVisits = (cycle == MultigridWCycle) ? 2 : 1;
+	for (int i = 0; i < numVisits; i++)
+	{
+		Cycle(jacobi, l + 1, cycle);
+	}
+
+	Prolongate(level.Pressure.Ping, coarse.Pressure.Ping, level.Pressure.Pong);
+	SwapSurfaces(&level.Pressure);
+	Smooth(jacobi, level, PostSmoothingSteps);
+}
+
+void createMultigrid(Surface obstacles, int width, int height, float cellSize)
+{
+	residualProgram = Shader("defaultVS.vs", "residual.fs").Program;
+	restrictProgram = Shader("defaultVS.vs", "restrict.fs").Program;
+	restrictObstaclesProgram = Shader("defaultVS.vs", "restrictObstacles.fs").Program;
+	prolongateProgram = Shader("defaultVS.vs", "prolongate.fs").Program;
+
+	// Level 0 is the simulation grid itself and is bound in MultigridSolve.
+	levels[0].Obstacles = obstacles;
+	levels[0].CellSize = cellSize;
+	numLevels = 1;
+
+	while (numLevels < MaxLevels)
+	{
+		int w = (width + 1) / 2;
+		int h = (height + 1) / 2;
+		if (w < MinLevelSize || h < MinLevelSize)
+			break;
+
+		MultigridLevel& level = levels[numLevels];
+		level.Pressure = createPingPongTexture(w, h, 1);
+		level.Divergence = createSurface(w, h, 1);
+		level.Obstacles = createSurface(w, h, 3);
+		level.CellSize = levels[numLevels - 1].CellSize * 2.0f;
+
+		Restrict(restrictObstaclesProgram, levels[numLevels - 1].Obstacles, level.Obstacles);
+		level.Mask = createMaskSurface(w, h);
+		createObstacleMask(level.Obstacles, level.Mask);
+
+		width = w;
+		height = h;
+		numLevels++;
+	}
+
+	std::cout << "Multigrid: " << numLevels << " levels, coarsest " << width << "x" << height << std::endl;
+}
+
+void MultigridSolve(Shader& jacobi, PingPongTexture* pressure, Surface divergence, Surface obstacles, Surface obstacleMask, MultigridCycle cycle, int numCycles)
+{
+	levels[0].Pressure = *pressure;
+	levels[0].Divergence = divergence;
+	levels[0].Obstacles = obstacles;
+	levels[0].Mask = obstacleMask;
+
+	for (int i = 0; i < numCycles; i++)
+	{
+		Cycle(jacobi, 0, cycle);
+	}
+
+	*pressure = levels[0].Pressure;
+	SetViewport(pressure->Ping);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+#define PreSmoothingSteps (2)
+#define PostSmoothingSteps (2)
+
+typedef enum MultigridCycle_ {
+	MultigridVCycle,
+	MultigridWCycle
+} MultigridCycle;
+
+typedef struct MultigridLevel_ {
+	PingPongTexture Pressure;
+	Surface Divergence;
+	Surface Obstacles;
+	Surface Mask;
+	float CellSize;
+} MultigridLevel;
+
+void createMultigrid(Surface obstacles, int width, int height, float cellSize);
+void MultigridSolve(Shader& jacobi, PingPongTexture* pressure, Surface divergence, Surface obstacles, Surface obstacleMask, MultigridCycle cycle, int numCycles);
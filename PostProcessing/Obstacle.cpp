@@ -1,7 +1,42 @@
 #include "stdafx.h"
 #include "Obstacle.h"
 
-void createObstacles(Surface dest, int width, int height)
+// Packs the solid flags of each cell and its four neighbors into an R8UI mask,
+// so stencil shaders learn their boundary configuration from a single fetch.
+void createObstacleMask(Surface obstacles, Surface mask)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mask.FboHandle);
+	glViewport(0, 0, mask.Width, mask.Height);
+
+	GLint previousVao;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	Shader program("defaultVS.vs", "obstacleMask.fs");
+
+	program.Use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+
+	float positions[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+	GLuint vbo;
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(positions), positions, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(positions[0]), 0);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	// Cleanup
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteBuffers(1, &vbo);
+	glDeleteProgram(program.Program);
+	glDeleteVertexArrays(1, &vao);
+	glBindVertexArray(previousVao);
+}
+
+void createObstacles(Surface dest, Surface mask, int width, int height)
 {
 	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
 	glViewport(0, 0, width, height);
@@ -36,4 +71,6 @@ void createObstacles(Surface dest, int width, int height)
 	// Cleanup
 	glDeleteProgram(program.Program);
 	glDeleteVertexArrays(1, &vao);
+
+	createObstacleMask(dest, mask);
 }
\ No newline at end of file
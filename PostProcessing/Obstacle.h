@@ -3,4 +3,5 @@
 #include "FluidSimulation.h"
 #include "Shader.h"
 
-void createObstacles(Surface dest, int width, int height);
+void createObstacles(Surface dest, Surface mask, int width, int height);
+void createObstacleMask(Surface obstacles, Surface mask);
@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "PackedJacobi.h"
+#include "TextureHandler.h"
+
+// The packed layout stores the 2x2 block of cells (2i, 2j)..(2i + 1, 2j + 1) in one
+// RGBA texel as r = (0, 0), g = (1, 0), b = (0, 1), a = (1, 1).
+static GLuint packProgram, unpackProgram, packMaskProgram, jacobiPackedProgram;
+static PingPongTexture packedPressure;
+static Surface packedDivergence, packedMask;
+
+static void SetViewport(Surface s)
+{
+	glViewport(0, 0, s.Width, s.Height);
+}
+
+static void Pack(Surface source, Surface dest)
+{
+	glUseProgram(packProgram);
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+}
+
+static void Unpack(Surface source, Surface dest)
+{
+	glUseProgram(unpackProgram);
+	SetViewport(dest);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+}
+
+// Grid dimensions are assumed even; an odd last row or column would be dropped.
+void createPackedJacobi(Surface obstacleMask, int width, int height)
+{
+	packProgram = Shader("defaultVS.vs", "packScalar.fs").Program;
+	unpackProgram = Shader("defaultVS.vs", "unpackScalar.fs").Program;
+	packMaskProgram = Shader("defaultVS.vs", "packMask.fs").Program;
+	jacobiPackedProgram = Shader("defaultVS.vs", "jacobiPacked.fs").Program;
+
+	packedPressure = createPingPongTexture(width / 2, height / 2, 4);
+	packedDivergence = createSurface(width / 2, height / 2, 4);
+	packedMask = createMaskSurface(width / 2, height / 2, 4);
+
+	glUseProgram(packMaskProgram);
+	SetViewport(packedMask);
+	glBindFramebuffer(GL_FRAMEBUFFER, packedMask.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+	glViewport(0, 0, width, height);
+}
+
+// Runs numIterations weighted Jacobi sweeps on the packed layout, four cells per
+// fragment. Pressure and divergence are packed on the way in and pressure is
+// unpacked on the way out, so the rest of the step sees the usual layout.
+// A null omegas runs plain Jacobi.
+void PackedJacobiSolve(Surface pressure, Surface divergence, float cellSize, const float* omegas, int numIterations)
+{
+	Pack(pressure, packedPressure.Ping);
+	Pack(divergence, packedDivergence);
+
+	GLuint p = jacobiPackedProgram;
+	glUseProgram(p);
+
+	GLint alpha = glGetUniformLocation(p, "Alpha");
+	GLint inverseBeta = glGetUniformLocation(p, "InverseBeta");
+	GLint omegaLoc = glGetUniformLocation(p, "Omega");
+	GLint dSampler = glGetUniformLocation(p, "Divergence");
+	GLint oSampler = glGetUniformLocation(p, "ObstacleMask");
+
+	glUniform1f(alpha, -cellSize * cellSize);
+	glUniform1f(inverseBeta, 0.25f);
+	glUniform1i(dSampler, 1);
+	glUniform1i(oSampler, 2);
+
+	SetViewport(packedPressure.Ping);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, packedDivergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, packedMask.TextureHandle);
+
+	for (int i = 0; i < numIterations; i++)
+	{
+		glUniform1f(omegaLoc, omegas ? omegas[i] : 1.0f);
+		glBindFramebuffer(GL_FRAMEBUFFER, packedPressure.Pong.FboHandle);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, packedPressure.Ping.TextureHandle);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+		SwapSurfaces(&packedPressure);
+	}
+	ResetState();
+
+	Unpack(packedPressure.Ping, pressure);
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+void createPackedJacobi(Surface obstacleMask, int width, int height);
+void PackedJacobiSolve(Surface pressure, Surface divergence, float cellSize, const float* omegas, int numIterations);
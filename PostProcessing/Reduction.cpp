@@ -0,0 +1,63 @@
+#include "stdafx.h"
+#include "Reduction.h"
+#include "TextureHandler.h"
+
+static GLuint reduceProgram;
+
+ReductionChain createReductionChain(int width, int height)
+{
+	if (!reduceProgram)
+		reduceProgram = Shader("defaultVS.vs", "reduce.fs").Program;
+
+	ReductionChain chain;
+	chain.NumLevels = 0;
+	do
+	{
+		width = (width + 3) / 4;
+		height = (height + 3) / 4;
+		chain.Levels[chain.NumLevels++] = createSurface(width, height, 1, false);
+	} while ((width > 4 || height > 4) && chain.NumLevels < MaxReductionLevels);
+
+	return chain;
+}
+
+void ReducePass(ReductionOperator op, Surface source, Surface dest)
+{
+	GLuint p = reduceProgram;
+	glUseProgram(p);
+
+	GLint sourceSize = glGetUniformLocation(p, "SourceSize");
+	GLint operation = glGetUniformLocation(p, "Operation");
+	glUniform2i(sourceSize, source.Width, source.Height);
+	glUniform1i(operation, op);
+
+	glViewport(0, 0, dest.Width, dest.Height);
+	glBindFramebuffer(GL_FRAMEBUFFER, dest.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	ResetState();
+}
+
+// Reduces chain.Levels[0], filled by the caller, down to the 1x1 dest.
+void Reduce(ReductionChain& chain, ReductionOperator op, Surface dest)
+{
+	for (int i = 1; i < chain.NumLevels; i++)
+	{
+		ReducePass(op, chain.Levels[i - 1], chain.Levels[i]);
+	}
+	ReducePass(op, chain.Levels[chain.NumLevels - 1], dest);
+}
+
+// Squares and magnitudes are only taken on the first pass; the rest of the chain
+// sums or maxes them.
+void ReduceSurface(ReductionChain& chain, Surface source, ReductionOperator op, Surface dest)
+{
+	ReductionOperator rest = op;
+	if (op == ReductionSumOfSquares) rest = ReductionSum;
+	if (op == ReductionMaxMagnitude) rest = ReductionMax;
+
+	ReducePass(op, source, chain.Levels[0]);
+	Reduce(chain, rest, dest);
+}
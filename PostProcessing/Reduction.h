@@ -0,0 +1,24 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+#define MaxReductionLevels (16)
+
+typedef enum ReductionOperator_ {
+	ReductionSum,
+	ReductionMax,
+	ReductionSumOfSquares,
+	ReductionMaxMagnitude
+} ReductionOperator;
+
+// Levels[0] is a quarter of the source size in each dimension, the last level is at most 4x4.
+typedef struct ReductionChain_ {
+	Surface Levels[MaxReductionLevels];
+	int NumLevels;
+} ReductionChain;
+
+ReductionChain createReductionChain(int width, int height);
+void ReducePass(ReductionOperator op, Surface source, Surface dest);
+void Reduce(ReductionChain& chain, ReductionOperator op, Surface dest);
+void ReduceSurface(ReductionChain& chain, Surface source, ReductionOperator op, Surface dest);
@@ -0,0 +1,110 @@
+#include "stdafx.h"
+#include "Residual.h"
+#include "Reduction.h"
+#include "TextureHandler.h"
+
+// Number of readbacks that may be in flight before new requests are dropped.
+#define ReadbackRingSize (3)
+
+static GLuint residualProgram;
+static Surface residual, sumOfSquares;
+static ReductionChain chain;
+static GLuint readbackPbos[ReadbackRingSize];
+static GLsync readbackFences[ReadbackRingSize];
+static int readbackHead, readbackTail;
+
+void createResidualNorm(int width, int height)
+{
+	residualProgram = Shader("defaultVS.vs", "residual.fs").Program;
+	residual = createSurface(width, height, 1, false);
+	sumOfSquares = createSurface(1, 1, 1, false);
+	chain = createReductionChain(width, height);
+
+	glGenBuffers(ReadbackRingSize, readbackPbos);
+	for (int i = 0; i < ReadbackRingSize; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float), 0, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// Leaves the sum of squared residuals of the pressure equation in a 1x1 surface on the GPU.
+void ResidualNorm(Surface pressure, Surface divergence, Surface obstacleMask, float cellSize)
+{
+	GLuint p = residualProgram;
+	glUseProgram(p);
+
+	GLint inverseCellSizeSquared = glGetUniformLocation(p, "InverseCellSizeSquared");
+	GLint dSampler = glGetUniformLocation(p, "Divergence");
+	GLint oSampler = glGetUniformLocation(p, "ObstacleMask");
+
+	glUniform1f(inverseCellSizeSquared, 1.0f / (cellSize * cellSize));
+	glUniform1i(dSampler, 1);
+	glUniform1i(oSampler, 2);
+
+	glViewport(0, 0, residual.Width, residual.Height);
+	glBindFramebuffer(GL_FRAMEBUFFER, residual.FboHandle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pressure.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, divergence.TextureHandle);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, obstacleMask.TextureHandle);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	ResetState();
+
+	ReduceSurface(chain, residual, ReductionSumOfSquares, sumOfSquares);
+	glViewport(0, 0, residual.Width, residual.Height);
+}
+
+// Blocking readback of the last ResidualNorm as an RMS value.
+float ReadResidualNorm()
+{
+	float sum = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, sumOfSquares.FboHandle);
+	glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, &sum);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return sqrtf(sum / (residual.Width * residual.Height));
+}
+
+// Queues an asynchronous readback of the last ResidualNorm. If the ring is full
+// the request is dropped rather than waiting on the GPU.
+void RequestResidualNorm()
+{
+	if (readbackHead - readbackTail == ReadbackRingSize)
+		return;
+
+	int slot = readbackHead % ReadbackRingSize;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbos[slot]);
+	glBindFramebuffer(GL_FRAMEBUFFER, sumOfSquares.FboHandle);
+	glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, (void*)0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackHead++;
+}
+
+// Returns the oldest requested RMS residual once the GPU has produced it, without blocking.
+bool PollResidualNorm(float* norm)
+{
+	if (readbackTail == readbackHead)
+		return false;
+
+	int slot = readbackTail % ReadbackRingSize;
+	GLenum status = glClientWaitSync(readbackFences[slot], 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return false;
+
+	glDeleteSync(readbackFences[slot]);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbos[slot]);
+	float* sum = (float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float), GL_MAP_READ_BIT);
+	*norm = sqrtf(*sum / (residual.Width * residual.Height));
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readbackTail++;
+	return true;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+void createResidualNorm(int width, int height);
+void ResidualNorm(Surface pressure, Surface divergence, Surface obstacleMask, float cellSize);
+float ReadResidualNorm();
+void RequestResidualNorm();
+bool PollResidualNorm(float* norm);
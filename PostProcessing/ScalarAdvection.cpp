@@ -0,0 +1,70 @@
+#include "stdafx.h"
+#include "ScalarAdvection.h"
+
+static GLuint advectScalarsProgram;
+static GLuint slabsFbo;
+
+void createScalarAdvection()
+{
+	advectScalarsProgram = Shader("defaultVS.vs", "advectScalars.fs").Program;
+	glGenFramebuffers(1, &slabsFbo);
+}
+
+// Semi-Lagrangian advection of up to MaxScalarSlabs slabs along one back-traced
+// coordinate, written through multiple render targets. The slabs must share a size,
+// which may be finer than velocity. Swaps every slab.
+void AdvectScalars(Surface velocity, Surface obstacles, PingPongTexture* slabs, int numSlabs, float timeStep, float dissipation)
+{
+	if (numSlabs > MaxScalarSlabs) numSlabs = MaxScalarSlabs;
+	Surface dest = slabs[0].Pong;
+
+	GLuint p = advectScalarsProgram;
+	glUseProgram(p);
+
+	glUniform2f(glGetUniformLocation(p, "InverseSize"), 1.0f / dest.Width, 1.0f / dest.Height);
+	glUniform1f(glGetUniformLocation(p, "TimeStep"), timeStep);
+	glUniform1f(glGetUniformLocation(p, "VelocityScale"), (float)dest.Width / velocity.Width);
+	glUniform1f(glGetUniformLocation(p, "Dissipation"), dissipation);
+	glUniform1i(glGetUniformLocation(p, "NumSlabs"), numSlabs);
+	glUniform1i(glGetUniformLocation(p, "Obstacles"), 1);
+	glUniform1i(glGetUniformLocation(p, "DensityScale"), dest.Width / obstacles.Width);
+
+	const char* names[] = { "Slab0", "Slab1", "Slab2", "Slab3" };
+	GLenum drawBuffers[MaxScalarSlabs];
+	glBindFramebuffer(GL_FRAMEBUFFER, slabsFbo);
+	for (int i = 0; i < MaxScalarSlabs; i++)
+	{
+		GLuint target = (i < numSlabs) ? slabs[i].Pong.TextureHandle : 0;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, target, 0);
+		drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+		glUniform1i(glGetUniformLocation(p, names[i]), 2 + i);
+	}
+	glDrawBuffers(numSlabs, drawBuffers);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, dest.Width, dest.Height);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, velocity.TextureHandle);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, obstacles.TextureHandle);
+	for (int i = 0; i < numSlabs; i++)
+	{
+		glActiveTexture(GL_TEXTURE2 + i);
+		glBindTexture(GL_TEXTURE_2D, slabs[i].Ping.TextureHandle);
+	}
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	for (int i = numSlabs - 1; i >= 2; i--)
+	{
+		glActiveTexture(GL_TEXTURE2 + i); glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	ResetState();
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+	for (int i = 0; i < numSlabs; i++)
+	{
+		SwapSurfaces(&slabs[i]);
+	}
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+// Passive scalars are packed four to an RGBA slab; one pass writes every slab.
+#define MaxScalarSlabs (4)
+
+void createScalarAdvection();
+void AdvectScalars(Surface velocity, Surface obstacles, PingPongTexture* slabs, int numSlabs, float timeStep, float dissipation);
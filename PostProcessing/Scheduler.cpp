@@ -0,0 +1,41 @@
+#include "stdafx.h"
+#include "Scheduler.h"
+
+#include <cmath>
+
+FixedStepScheduler createScheduler(double ticksPerSecond, int maxCatchUpTicks, double now)
+{
+	FixedStepScheduler scheduler;
+	scheduler.TickDuration = 1.0 / ticksPerSecond;
+	scheduler.MaxCatchUpTicks = maxCatchUpTicks;
+	scheduler.Accumulator = 0.0;
+	scheduler.LastTime = now;
+	return scheduler;
+}
+
+// Returns the number of ticks due at time now. When more than MaxCatchUpTicks are due,
+// as after a stall, the rest of the backlog is dropped and the simulation falls behind
+// wall-clock time instead of spending ever longer frames catching up.
+int ScheduleTicks(FixedStepScheduler* scheduler, double now)
+{
+	scheduler->Accumulator += now - scheduler->LastTime;
+	scheduler->LastTime = now;
+
+	int ticks = (int)(scheduler->Accumulator / scheduler->TickDuration);
+	if (ticks > scheduler->MaxCatchUpTicks)
+	{
+		ticks = scheduler->MaxCatchUpTicks;
+		scheduler->Accumulator = fmod(scheduler->Accumulator, scheduler->TickDuration);
+	}
+	else
+	{
+		scheduler->Accumulator -= ticks * scheduler->TickDuration;
+	}
+	return ticks;
+}
+
+// How far wall-clock time is between the last two ticks, in [0, 1).
+float InterpolationFactor(const FixedStepScheduler* scheduler)
+{
+	return (float)(scheduler->Accumulator / scheduler->TickDuration);
+}
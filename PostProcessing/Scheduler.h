@@ -0,0 +1,15 @@
+#pragma once
+#include "stdafx.h"
+
+// Fixed-rate simulation ticks from wall-clock time. Time not yet simulated is kept
+// in Accumulator; rendering interpolates across it.
+typedef struct FixedStepScheduler_ {
+	double TickDuration;
+	int MaxCatchUpTicks;
+	double Accumulator;
+	double LastTime;
+} FixedStepScheduler;
+
+FixedStepScheduler createScheduler(double ticksPerSecond, int maxCatchUpTicks, double now);
+int ScheduleTicks(FixedStepScheduler* scheduler, double now);
+float InterpolationFactor(const FixedStepScheduler* scheduler);
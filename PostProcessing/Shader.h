@@ -95,4 +95,63 @@ public:
 	}
 };
 
+class ComputeShader
+{
+public:
+	GLuint Program;
+	// Constructor generates the compute shader on the fly
+	ComputeShader(const GLchar* computePath)
+	{
+		// 1. Retrieve the compute source code from filePath
+		std::string computeCode;
+		std::ifstream cShaderFile;
+		// ensures ifstream objects can throw exceptions:
+		cShaderFile.exceptions(std::ifstream::badbit);
+		try
+		{
+			cShaderFile.open(computePath);
+			std::stringstream cShaderStream;
+			cShaderStream << cShaderFile.rdbuf();
+			cShaderFile.close();
+			computeCode = cShaderStream.str();
+		}
+		catch (std::ifstream::failure e)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+		}
+		const GLchar* cShaderCode = computeCode.c_str();
+		// 2. Compile shader
+		GLuint compute;
+		GLint success;
+		GLchar infoLog[512];
+		compute = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(compute, 1, &cShaderCode, NULL);
+		glCompileShader(compute);
+		// Print compile errors if any
+		glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(compute, 512, NULL, infoLog);
+			std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+		}
+		// Shader Program
+		this->Program = glCreateProgram();
+		glAttachShader(this->Program, compute);
+		glLinkProgram(this->Program);
+		// Print linking errors if any
+		glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
+			std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+		}
+		glDeleteShader(compute);
+	}
+	// Uses the current shader
+	void Use()
+	{
+		glUseProgram(this->Program);
+	}
+};
+
 #endif
\ No newline at end of file
@@ -2,8 +2,54 @@
 
 #include "TextureHandler.h"
 
+// Bytes of every surface and depth-stencil buffer created so far.
+static double AllocatedBytes = 0;
+
+double SurfaceBytesAllocated()
+{
+	return AllocatedBytes;
+}
+
 Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 {
+	return createSurface(width, height, numComponents, true);
+}
+
+int BytesPerTexel(FieldFormat format)
+{
+	switch (format.Precision)
+	{
+	case PrecisionHalf: return 2 * format.NumComponents;
+	case PrecisionFloat: return 4 * format.NumComponents;
+	default: return format.NumComponents;
+	}
+}
+
+const char* FormatName(FieldFormat format)
+{
+	static const char* names[][4] = {
+		{ "R8", "RG8", "RGB8", "RGBA8" },
+		{ "R8UI", "RG8UI", "RGB8UI", "RGBA8UI" },
+		{ "R16F", "RG16F", "RGB16F", "RGBA16F" },
+		{ "R32F", "RG32F", "RGB32F", "RGBA32F" },
+	};
+	return names[format.Precision][format.NumComponents - 1];
+}
+
+Surface createSurface(GLsizei width, GLsizei height, int numComponents, bool useHalfFloats)
+{
+	FieldFormat format = { numComponents, useHalfFloats ? PrecisionHalf : PrecisionFloat };
+	return createSurface(width, height, format);
+}
+
+Surface createSurface(GLsizei width, GLsizei height, FieldFormat format)
+{
+	if (format.Precision == PrecisionUint8)
+	{
+		return createMaskSurface(width, height, format.NumComponents);
+	}
+
+	int numComponents = format.NumComponents;
 	GLuint fboHandle;
 	glGenFramebuffers(1, &fboHandle);
 	glBindFramebuffer(GL_FRAMEBUFFER, fboHandle);
@@ -16,8 +62,7 @@ Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	const int UseHalfFloats = 1;
-	if (UseHalfFloats) 
+	if (format.Precision == PrecisionHalf) 
 	{
 		switch (numComponents)
 		{
@@ -28,7 +73,7 @@ Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 		default: std::cout << "Illegal slab format.";
 		}
 	}
-	else 
+	else if (format.Precision == PrecisionFloat)
 	{
 		switch (numComponents) 
 		{
@@ -39,8 +84,20 @@ Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 		default: std::cout << "Illegal slab format.";
 		}
 	}
+	else
+	{
+		switch (numComponents) 
+		{
+		case 1: glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, 0); break;
+		case 2: glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, width, height, 0, GL_RG, GL_UNSIGNED_BYTE, 0); break;
+		case 3: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0); break;
+		case 4: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0); break;
+		default: std::cout << "Illegal slab format.";
+		}
+	}
 
 	if (GL_NO_ERROR != glGetError()) std::cout << "Unable to create normals texture";
+	AllocatedBytes += (double)BytesPerTexel(format) * width * height;
 
 	GLuint colorbuffer;
 	glGenRenderbuffers(1, &colorbuffer);
@@ -49,7 +106,7 @@ Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 	if (GL_NO_ERROR != glGetError()) std::cout << "Unable to attach color buffer";
 
 	if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) std::cout << "Unable to create FBO.";
-	Surface surface = { fboHandle, textureHandle, numComponents };
+	Surface surface = { fboHandle, textureHandle, numComponents, width, height };
 
 	glClearColor(0, 0, 0, 0);
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -58,11 +115,86 @@ Surface createSurface(GLsizei width, GLsizei height, int numComponents)
 	return surface;
 }
 
+Surface createMaskSurface(GLsizei width, GLsizei height)
+{
+	return createMaskSurface(width, height, 1);
+}
+
+// R8UI or RGBA8UI surface for bit masks; integer textures cannot be filtered.
+Surface createMaskSurface(GLsizei width, GLsizei height, int numComponents)
+{
+	GLuint fboHandle;
+	glGenFramebuffers(1, &fboHandle);
+	glBindFramebuffer(GL_FRAMEBUFFER, fboHandle);
+
+	GLuint textureHandle;
+	glGenTextures(1, &textureHandle);
+	glBindTexture(GL_TEXTURE_2D, textureHandle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	switch (numComponents)
+	{
+	case 1: glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, width, height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, 0); break;
+	case 4: glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, 0); break;
+	default: std::cout << "Illegal mask format.";
+	}
+	if (GL_NO_ERROR != glGetError()) std::cout << "Unable to create mask texture";
+	AllocatedBytes += (double)numComponents * width * height;
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureHandle, 0);
+	if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) std::cout << "Unable to create FBO.";
+	Surface surface = { fboHandle, textureHandle, numComponents, width, height };
+
+	GLuint zero[] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, zero);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return surface;
+}
+
+GLuint createDepthStencil(GLsizei width, GLsizei height)
+{
+	GLuint depthStencil;
+	glGenRenderbuffers(1, &depthStencil);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthStencil);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	if (GL_NO_ERROR != glGetError()) std::cout << "Unable to create depth-stencil buffer";
+	AllocatedBytes += 4.0 * width * height;
+
+	return depthStencil;
+}
+
+// Several surfaces may share one depth-stencil buffer; it is filled once and only tested against.
+void attachDepthStencil(Surface surface, GLuint depthStencil)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, surface.FboHandle);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+	if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER)) std::cout << "Unable to attach depth-stencil buffer.";
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, int numComponents)
+{
+	return createPingPongTexture(width, height, numComponents, true);
+}
+
+PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, int numComponents, bool useHalfFloats)
+{
+	PingPongTexture pingPong;
+	pingPong.Ping = createSurface(width, height, numComponents, useHalfFloats);
+	pingPong.Pong = createSurface(width, height, numComponents, useHalfFloats);
+
+	return pingPong;
+}
+
+PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, FieldFormat format)
 {
 	PingPongTexture pingPong;
-	pingPong.Ping = createSurface(width, height, numComponents);
-	pingPong.Pong = createSurface(width, height, numComponents);
+	pingPong.Ping = createSurface(width, height, format);
+	pingPong.Pong = createSurface(width, height, format);
 
 	return pingPong;
 }
\ No newline at end of file
@@ -3,5 +3,29 @@
 
 #include "FluidSimulation.h"
 
+typedef enum TexelPrecision_ {
+	PrecisionUnorm8,
+	PrecisionUint8,
+	PrecisionHalf,
+	PrecisionFloat
+} TexelPrecision;
+
+// Channel count and precision a field is stored with.
+typedef struct FieldFormat_ {
+	int NumComponents;
+	TexelPrecision Precision;
+} FieldFormat;
+
+int BytesPerTexel(FieldFormat format);
+double SurfaceBytesAllocated();
+const char* FormatName(FieldFormat format);
 Surface createSurface(GLsizei width, GLsizei height, int numComponents);
+Surface createSurface(GLsizei width, GLsizei height, int numComponents, bool useHalfFloats);
+Surface createSurface(GLsizei width, GLsizei height, FieldFormat format);
+Surface createMaskSurface(GLsizei width, GLsizei height);
+Surface createMaskSurface(GLsizei width, GLsizei height, int numComponents);
+GLuint createDepthStencil(GLsizei width, GLsizei height);
+void attachDepthStencil(Surface surface, GLuint depthStencil);
 PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, int numComponents);
+PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, int numComponents, bool useHalfFloats);
+PingPongTexture createPingPongTexture(GLsizei width, GLsizei height, FieldFormat format);
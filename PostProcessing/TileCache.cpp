@@ -0,0 +1,522 @@
+#include "stdafx.h"
+#include "TileCache.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static size_t TileTexels(const TileCacheHeader& header)
+{
+	return (size_t)header.TileSize * header.TileSize * header.NumComponents;
+}
+
+static float HalfToFloat(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1F;
+	uint32_t mantissa = h & 0x3FF;
+	uint32_t bits;
+	if (exponent == 0x1F)
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else if (mantissa == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		// Subnormal: normalize the mantissa.
+		exponent = 113;
+		while (!(mantissa & 0x400))
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// Writer: update() copies each cached frame into a ring of TileCacheQueueSlots
+// preallocated slots, and a writer thread tiles, writes and flushes it. When the ring is
+// full the frame is dropped rather than waited for, unless the caller asks to wait.
+typedef struct TileCacheJob_ {
+	int Frame;
+	std::vector<uint16_t> Texels;
+} TileCacheJob;
+
+static FILE* cacheFile;
+static TileCacheHeader cacheHeader;
+static std::vector<TileCacheFrame> cacheFrames;
+static uint64_t cacheOffset;
+static uint64_t storedTiles, totalTiles;
+static uint16_t emptyLimit;
+static int droppedFrames;
+static TileCacheJob jobs[TileCacheQueueSlots];
+static unsigned jobsHead, jobsTail;
+static bool closing;
+static std::mutex jobsMutex;
+static std::condition_variable jobsReady, slotFree;
+static std::thread writerThread;
+
+// Tiles one frame of Width * Height texels, bottom row first, and appends its record,
+// stored tiles and directory.
+static void WriteCachedFrame(const uint16_t* texels, int frame, std::vector<uint16_t>& tiles)
+{
+	const TileCacheHeader& h = cacheHeader;
+	int numTiles = h.TilesX * h.TilesY;
+	size_t tileTexels = TileTexels(h);
+	size_t tileRow = (size_t)h.TileSize * h.NumComponents;
+	std::vector<uint32_t> directory(numTiles, EmptyCachedTile);
+
+	TileCacheFrame entry = { TileCacheFrameMagic, frame, 0, 0, cacheOffset + sizeof(TileCacheFrame), 0 };
+	tiles.resize((size_t)numTiles * tileTexels);
+	for (int t = 0; t < numTiles; t++)
+	{
+		int x0 = (t % h.TilesX) * h.TileSize;
+		int y0 = (t / h.TilesX) * h.TileSize;
+		int columns = (h.Width - x0 < h.TileSize) ? h.Width - x0 : h.TileSize;
+		size_t rowLength = (size_t)columns * h.NumComponents;
+
+		uint16_t* tile = tiles.data() + entry.NumTiles * tileTexels;
+		std::fill(tile, tile + tileTexels, (uint16_t)0);
+		bool empty = true;
+		for (int y = 0; y < h.TileSize && y0 + y < h.Height; y++)
+		{
+			const uint16_t* source = texels + ((size_t)(y0 + y) * h.Width + x0) * h.NumComponents;
+			uint16_t* dest = tile + y * tileRow;
+			for (size_t i = 0; i < rowLength; i++)
+			{
+				dest[i] = source[i];
+				empty = empty && (source[i] & 0x7FFF) <= emptyLimit;
+			}
+		}
+		if (!empty)
+		{
+			directory[t] = entry.NumTiles++;
+		}
+	}
+
+	entry.DirectoryOffset = entry.DataOffset + (uint64_t)entry.NumTiles * tileTexels * sizeof(uint16_t);
+	size_t tileCount = entry.NumTiles * tileTexels;
+	bool ok = fwrite(&entry, sizeof(entry), 1, cacheFile) == 1
+		&& fwrite(tiles.data(), sizeof(uint16_t), tileCount, cacheFile) == tileCount
+		&& fwrite(directory.data(), sizeof(uint32_t), directory.size(), cacheFile) == directory.size()
+		&& fflush(cacheFile) == 0;
+	if (!ok)
+	{
+		std::cout << "History cache write failed." << std::endl;
+	}
+	cacheOffset = entry.DirectoryOffset + directory.size() * sizeof(uint32_t);
+	cacheFrames.push_back(entry);
+
+	storedTiles += entry.NumTiles;
+	totalTiles += numTiles;
+}
+
+static void WriterLoop()
+{
+	std::vector<uint16_t> tiles;
+	std::unique_lock<std::mutex> lock(jobsMutex);
+	for (;;)
+	{
+		jobsReady.wait(lock, [] { return jobsHead != jobsTail || closing; });
+		if (jobsHead == jobsTail)
+			break;
+
+		TileCacheJob& job = jobs[jobsTail % TileCacheQueueSlots];
+		lock.unlock();
+		WriteCachedFrame(job.Texels.data(), job.Frame, tiles);
+		lock.lock();
+		jobsTail++;
+		slotFree.notify_one();
+	}
+}
+
+// Tiles whose texels are all at most emptyThreshold in magnitude are not stored and read
+// back as zero.
+bool openTileCacheWriter(const char* path, int width, int height, int numComponents, float emptyThreshold)
+{
+	cacheFile = fopen(path, "wb");
+	if (!cacheFile)
+	{
+		std::cout << "Could not open " << path << " for writing." << std::endl;
+		return false;
+	}
+
+	cacheHeader.Magic = TileCacheMagic;
+	cacheHeader.Version = TileCacheVersion;
+	cacheHeader.Width = width;
+	cacheHeader.Height = height;
+	cacheHeader.NumComponents = numComponents;
+	cacheHeader.TileSize = TileCacheSize;
+	cacheHeader.TilesX = (width + TileCacheSize - 1) / TileCacheSize;
+	cacheHeader.TilesY = (height + TileCacheSize - 1) / TileCacheSize;
+	cacheHeader.EmptyThreshold = emptyThreshold;
+	cacheHeader.Reserved = 0;
+	fwrite(&cacheHeader, sizeof(cacheHeader), 1, cacheFile);
+
+	// Half float magnitudes order like their bit patterns, so the test is an integer compare.
+	emptyLimit = 0;
+	while (emptyLimit < 0x7C00 && HalfToFloat((uint16_t)(emptyLimit + 1)) <= emptyThreshold)
+	{
+		emptyLimit++;
+	}
+
+	cacheOffset = sizeof(cacheHeader);
+	cacheFrames.clear();
+	storedTiles = 0;
+	totalTiles = 0;
+	droppedFrames = 0;
+
+	for (int i = 0; i < TileCacheQueueSlots; i++)
+	{
+		jobs[i].Texels.resize((size_t)width * height * numComponents);
+	}
+	jobsHead = 0;
+	jobsTail = 0;
+	closing = false;
+	writerThread = std::thread(WriterLoop);
+	return true;
+}
+
+// Queues one frame of width * height texels, bottom row first, as read back from the
+// field. Returns false if the frame was dropped.
+bool AppendCachedFrame(const uint16_t* texels, int frame, bool wait)
+{
+	if (!cacheFile)
+		return false;
+
+	std::unique_lock<std::mutex> lock(jobsMutex);
+	if (wait)
+	{
+		slotFree.wait(lock, [] { return jobsHead - jobsTail < TileCacheQueueSlots; });
+	}
+	if (jobsHead - jobsTail >= TileCacheQueueSlots)
+	{
+		droppedFrames++;
+		return false;
+	}
+	lock.unlock();
+
+	// Only the writer moves jobsTail, and never past jobsHead, so this slot is ours.
+	TileCacheJob& job = jobs[jobsHead % TileCacheQueueSlots];
+	job.Frame = frame;
+	std::copy(texels, texels + job.Texels.size(), job.Texels.begin());
+
+	lock.lock();
+	jobsHead++;
+	lock.unlock();
+	jobsReady.notify_one();
+	return true;
+}
+
+// Waits for the writer to empty the queue, then appends the frame table and footer.
+void closeTileCacheWriter()
+{
+	if (!cacheFile)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		closing = true;
+	}
+	jobsReady.notify_one();
+	writerThread.join();
+
+	TileCacheFooter footer = { cacheOffset, (uint32_t)cacheFrames.size(), TileCacheTableMagic };
+	fwrite(cacheFrames.data(), sizeof(TileCacheFrame), cacheFrames.size(), cacheFile);
+	fwrite(&footer, sizeof(footer), 1, cacheFile);
+	fclose(cacheFile);
+	cacheFile = nullptr;
+
+	std::cout << "History cache: " << cacheFrames.size() << " frames, " << storedTiles << " of "
+		<< totalTiles << " tiles stored, " << droppedFrames << " frames dropped" << std::endl;
+}
+
+// A frame record is usable if it follows the previous frame, and its tiles and directory
+// lie between begin and end.
+static bool ValidFrame(const TileCacheHeader& h, const TileCacheFrame& entry, uint64_t begin, uint64_t end, int previousFrame)
+{
+	uint64_t numTiles = (uint64_t)h.TilesX * h.TilesY;
+	return entry.Magic == TileCacheFrameMagic && entry.Frame > previousFrame && entry.NumTiles <= numTiles
+		&& entry.DataOffset >= begin + sizeof(TileCacheFrame) && entry.DataOffset <= end
+		&& entry.DirectoryOffset == entry.DataOffset + entry.NumTiles * TileTexels(h) * sizeof(uint16_t)
+		&& entry.DirectoryOffset <= end && numTiles * sizeof(uint32_t) <= end - entry.DirectoryOffset;
+}
+
+// Opens a cache through its frame table, or, if the table is missing or damaged, by
+// walking the frame records from the start and keeping every complete frame.
+bool openTileCacheReader(const char* path, TileCacheReader* reader)
+{
+	reader->Frames.clear();
+	reader->Recovered = false;
+	if (!MapFile(path, &reader->File))
+	{
+		std::cout << "Could not map history cache " << path << "." << std::endl;
+		return false;
+	}
+
+	const MappedFile& file = reader->File;
+	TileCacheHeader& h = reader->Header;
+	bool ok = file.Size >= sizeof(TileCacheHeader);
+	if (ok)
+	{
+		memcpy(&h, file.Data, sizeof(TileCacheHeader));
+		ok = h.Magic == TileCacheMagic && h.Version == TileCacheVersion
+			&& h.Width > 0 && h.Height > 0 && h.NumComponents >= 1 && h.NumComponents <= 4 && h.TileSize > 0
+			&& h.TilesX == (h.Width + h.TileSize - 1) / h.TileSize && h.TilesY == (h.Height + h.TileSize - 1) / h.TileSize;
+	}
+	if (!ok)
+	{
+		std::cout << path << " is not a history cache." << std::endl;
+		UnmapFile(&reader->File);
+		return false;
+	}
+
+	TileCacheFooter footer = {};
+	if (file.Size >= sizeof(TileCacheHeader) + sizeof(footer))
+	{
+		memcpy(&footer, file.Data + file.Size - sizeof(footer), sizeof(footer));
+	}
+	bool table = footer.Magic == TileCacheTableMagic && footer.TableOffset >= sizeof(TileCacheHeader)
+		&& footer.TableOffset <= file.Size - sizeof(footer)
+		&& (uint64_t)footer.NumFrames * sizeof(TileCacheFrame) == file.Size - sizeof(footer) - footer.TableOffset;
+	if (table)
+	{
+		uint64_t begin = sizeof(TileCacheHeader);
+		for (uint32_t i = 0; table && i < footer.NumFrames; i++)
+		{
+			TileCacheFrame entry;
+			memcpy(&entry, file.Data + footer.TableOffset + i * sizeof(TileCacheFrame), sizeof(entry));
+			table = ValidFrame(h, entry, begin, footer.TableOffset, reader->Frames.empty() ? INT32_MIN : reader->Frames.back().Frame);
+			reader->Frames.push_back(entry);
+			begin = entry.DirectoryOffset + (uint64_t)h.TilesX * h.TilesY * sizeof(uint32_t);
+		}
+	}
+	if (!table)
+	{
+		reader->Frames.clear();
+		reader->Recovered = true;
+		uint64_t offset = sizeof(TileCacheHeader);
+		while (offset + sizeof(TileCacheFrame) <= file.Size)
+		{
+			TileCacheFrame entry;
+			memcpy(&entry, file.Data + offset, sizeof(entry));
+			if (entry.DataOffset != offset + sizeof(TileCacheFrame)
+				|| !ValidFrame(h, entry, offset, file.Size, reader->Frames.empty() ? INT32_MIN : reader->Frames.back().Frame))
+				break;
+			reader->Frames.push_back(entry);
+			offset = entry.DirectoryOffset + (uint64_t)h.TilesX * h.TilesY * sizeof(uint32_t);
+		}
+		std::cout << "History cache " << path << " has no frame table; recovered " << reader->Frames.size() << " frames." << std::endl;
+	}
+	return true;
+}
+
+void closeTileCacheReader(TileCacheReader* reader)
+{
+	UnmapFile(&reader->File);
+	reader->Frames.clear();
+}
+
+// Returns the position of frame in the cache, or -1 if it was not cached.
+int FindCachedFrame(const TileCacheReader& reader, int frame)
+{
+	int lo = 0, hi = (int)reader.Frames.size() - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (reader.Frames[mid].Frame == frame)
+			return mid;
+		if (reader.Frames[mid].Frame < frame)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -1;
+}
+
+// Decodes the rectangle at (x, y) of the given width and height into out, width * height
+// * NumComponents floats, bottom row first. Only the tiles the rectangle touches are read;
+// tiles skipped as empty, and texels outside the field, come back as zero. Returns false
+// if the frame was not cached or its directory names a tile it does not store.
+bool ReadCachedRegion(const TileCacheReader& reader, int frame, int x, int y, int width, int height, float* out)
+{
+	int index = FindCachedFrame(reader, frame);
+	if (index < 0 || width <= 0 || height <= 0)
+		return false;
+
+	const TileCacheHeader& h = reader.Header;
+	const TileCacheFrame& entry = reader.Frames[index];
+	const uint32_t* directory = (const uint32_t*)(reader.File.Data + entry.DirectoryOffset);
+	size_t tileTexels = TileTexels(h);
+	int nc = h.NumComponents;
+
+	memset(out, 0, (size_t)width * height * nc * sizeof(float));
+	if (x >= h.Width || y >= h.Height || x + width <= 0 || y + height <= 0)
+		return true;
+
+	int tx0 = (x > 0 ? x : 0) / h.TileSize, ty0 = (y > 0 ? y : 0) / h.TileSize;
+	int tx1 = (x + width - 1) / h.TileSize, ty1 = (y + height - 1) / h.TileSize;
+	if (tx1 >= h.TilesX) tx1 = h.TilesX - 1;
+	if (ty1 >= h.TilesY) ty1 = h.TilesY - 1;
+
+	for (int ty = ty0; ty <= ty1; ty++)
+	{
+		for (int tx = tx0; tx <= tx1; tx++)
+		{
+			uint32_t slot = directory[ty * h.TilesX + tx];
+			if (slot == EmptyCachedTile)
+				continue;
+			if (slot >= entry.NumTiles)
+				return false;
+			const uint16_t* tile = (const uint16_t*)(reader.File.Data + entry.DataOffset) + (size_t)slot * tileTexels;
+
+			// Overlap of this tile with the rectangle, in field coordinates.
+			int left = tx * h.TileSize, bottom = ty * h.TileSize;
+			int x0 = (x > left) ? x : left;
+			int y0 = (y > bottom) ? y : bottom;
+			int x1 = (x + width < left + h.TileSize) ? x + width : left + h.TileSize;
+			int y1 = (y + height < bottom + h.TileSize) ? y + height : bottom + h.TileSize;
+
+			for (int row = y0; row < y1; row++)
+			{
+				const uint16_t* source = tile + ((size_t)(row - bottom) * h.TileSize + (x0 - left)) * nc;
+				float* dest = out + ((size_t)(row - y) * width + (x0 - x)) * nc;
+				for (int i = 0; i < (x1 - x0) * nc; i++)
+				{
+					dest[i] = HalfToFloat(source[i]);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Test texel of the --verify-cache field: values in [1, 2), except that tile (1, 0) is
+// zero and the corner tile holds values below the empty threshold.
+static uint16_t VerifyTexel(int x, int y, int c, int frame)
+{
+	if (x / TileCacheSize == 1 && y / TileCacheSize == 0)
+		return 0;
+	if (x / TileCacheSize == 2 && y / TileCacheSize == 1)
+		return (uint16_t)(0x0100 + ((x + y) & 0xFF));
+	return (uint16_t)(0x3C00 + ((x * 7 + y * 13 + c * 3 + frame * 5) & 0x3FF));
+}
+
+// Reads one rectangle and compares it with what the writer was given.
+static bool VerifyRegion(const TileCacheReader& reader, int frame, int x, int y, int width, int height)
+{
+	const TileCacheHeader& h = reader.Header;
+	std::vector<float> region((size_t)width * height * h.NumComponents);
+	if (!ReadCachedRegion(reader, frame, x, y, width, height, region.data()))
+		return false;
+
+	for (int row = 0; row < height; row++)
+	{
+		for (int column = 0; column < width; column++)
+		{
+			for (int c = 0; c < h.NumComponents; c++)
+			{
+				int fx = x + column, fy = y + row;
+				float expected = 0;
+				if (fx >= 0 && fy >= 0 && fx < h.Width && fy < h.Height)
+				{
+					float value = HalfToFloat(VerifyTexel(fx, fy, c, frame));
+					expected = (value > h.EmptyThreshold) ? value : 0;
+				}
+				if (region[((size_t)row * width + column) * h.NumComponents + c] != expected)
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+// --verify-cache FILE: writes a few frames of a field that is not a whole number of
+// tiles to FILE, reads back rectangles crossing tile and field edges, then cuts the
+// frame table and the end of the last frame off a copy and reads that through recovery.
+// Both files are removed afterwards.
+bool VerifyTileCache(const char* path)
+{
+	const int width = 75, height = 50, numComponents = 2, numFrames = 3;
+	const int regions[][4] = {
+		{ 20, 20, 30, 20 }, // across the tile corner at (32, 32)
+		{ 60, 40, 30, 20 }, // past the right and top field edges
+		{ -5, -5, 10, 10 }, // past the left and bottom field edges
+		{ 40, 0, 10, 40 }, // the zero tile and its neighbour above
+		{ 0, 0, width, height },
+	};
+
+	if (!openTileCacheWriter(path, width, height, numComponents, 1e-3f))
+		return false;
+	std::vector<uint16_t> texels((size_t)width * height * numComponents);
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				for (int c = 0; c < numComponents; c++)
+					texels[((size_t)y * width + x) * numComponents + c] = VerifyTexel(x, y, c, frame);
+		AppendCachedFrame(texels.data(), frame, true);
+	}
+	closeTileCacheWriter();
+
+	TileCacheReader reader;
+	bool passed = openTileCacheReader(path, &reader);
+	if (passed)
+	{
+		// Of the six tiles per frame, the zero tile and the corner tile are not stored.
+		passed = !reader.Recovered && (int)reader.Frames.size() == numFrames && storedTiles == (uint64_t)numFrames * 4;
+		for (int frame = 0; passed && frame < numFrames; frame++)
+		{
+			for (const int* r : regions)
+			{
+				passed = passed && VerifyRegion(reader, frame, r[0], r[1], r[2], r[3]);
+			}
+		}
+		std::vector<float> region((size_t)width * height * numComponents);
+		passed = passed && !ReadCachedRegion(reader, numFrames, 0, 0, width, height, region.data());
+
+		// Cut inside the last frame's directory, as if the run had died writing it.
+		uint64_t truncated = reader.Frames.back().DirectoryOffset + 4;
+		std::string partial = std::string(path) + ".partial";
+		FILE* file = fopen(partial.c_str(), "wb");
+		passed = passed && file && fwrite(reader.File.Data, 1, (size_t)truncated, file) == truncated;
+		if (file)
+			fclose(file);
+		closeTileCacheReader(&reader);
+
+		TileCacheReader recovered;
+		if (passed && openTileCacheReader(partial.c_str(), &recovered))
+		{
+			passed = recovered.Recovered && (int)recovered.Frames.size() == numFrames - 1;
+			for (int frame = 0; passed && frame < numFrames - 1; frame++)
+			{
+				passed = VerifyRegion(recovered, frame, 0, 0, width, height);
+			}
+			closeTileCacheReader(&recovered);
+		}
+		else
+		{
+			passed = false;
+		}
+		remove(partial.c_str());
+	}
+	remove(path);
+
+	std::cout << "History cache check: " << (passed ? "passed" : "FAILED") << std::endl;
+	return passed;
+}
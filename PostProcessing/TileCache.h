@@ -0,0 +1,69 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <vector>
+
+// History cache files: a TileCacheHeader, then per cached frame a TileCacheFrame record,
+// the tiles that hold any texel above the header's EmptyThreshold, and the frame's tile
+// directory, then a table of all frame records and a TileCacheFooter. Tiles are
+// TileCacheSize texels square, half floats, padded with zeros past the field edge, so
+// every tile has the same size. A directory holds, per tile in row order from the
+// bottom, its index among the frame's stored tiles, or EmptyCachedTile. Each frame is
+// flushed once written, so a file whose run died before the table can still be read by
+// walking the frame records. All values are little-endian.
+#define TileCacheMagic (0x48435446u) // "FTCH"
+#define TileCacheFrameMagic (0x52465446u) // "FTFR"
+#define TileCacheTableMagic (0x4C425446u) // "FTBL"
+#define TileCacheVersion (2)
+#define TileCacheSize (32)
+#define TileCacheQueueSlots (8)
+#define EmptyCachedTile (0xFFFFFFFFu)
+
+typedef struct TileCacheHeader_ {
+	uint32_t Magic;
+	uint32_t Version;
+	int32_t Width;
+	int32_t Height;
+	int32_t NumComponents;
+	int32_t TileSize;
+	int32_t TilesX;
+	int32_t TilesY;
+	float EmptyThreshold;
+	uint32_t Reserved;
+} TileCacheHeader;
+
+typedef struct TileCacheFrame_ {
+	uint32_t Magic;
+	int32_t Frame;
+	uint32_t NumTiles;
+	uint32_t Reserved;
+	uint64_t DataOffset;
+	uint64_t DirectoryOffset;
+} TileCacheFrame;
+
+typedef struct TileCacheFooter_ {
+	uint64_t TableOffset;
+	uint32_t NumFrames;
+	uint32_t Magic;
+} TileCacheFooter;
+
+bool openTileCacheWriter(const char* path, int width, int height, int numComponents, float emptyThreshold);
+bool AppendCachedFrame(const uint16_t* texels, int frame, bool wait);
+void closeTileCacheWriter();
+
+typedef struct TileCacheReader_ {
+	MappedFile File;
+	TileCacheHeader Header;
+	std::vector<TileCacheFrame> Frames;
+	bool Recovered;
+} TileCacheReader;
+
+bool openTileCacheReader(const char* path, TileCacheReader* reader);
+void closeTileCacheReader(TileCacheReader* reader);
+int FindCachedFrame(const TileCacheReader& reader, int frame);
+bool ReadCachedRegion(const TileCacheReader& reader, int frame, int x, int y, int width, int height, float* out);
+
+bool VerifyTileCache(const char* path);
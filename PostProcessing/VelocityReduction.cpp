@@ -0,0 +1,55 @@
+#include "stdafx.h"
+#include "VelocityReduction.h"
+#include "Reduction.h"
+#include "AsyncReadback.h"
+#include "TextureHandler.h"
+
+static ReductionChain chain;
+static Surface maxSpeedSurface;
+static ReadbackRing readback;
+static float latestMaxSpeed;
+
+static void StoreMaxSpeed(const void* data, int width, int height, int numComponents, int frame, void* user)
+{
+	latestMaxSpeed = *(const float*)data;
+}
+
+// Returns false if the context has no sync objects to read the result back without stalling.
+bool createVelocityReduction(int width, int height)
+{
+	if (!GLEW_ARB_sync || !GLEW_ARB_pixel_buffer_object)
+	{
+		std::cout << "Velocity readback needs sync objects and pixel buffer objects." << std::endl;
+		return false;
+	}
+
+	chain = createReductionChain(width, height);
+	maxSpeedSurface = createSurface(1, 1, 1, false);
+	readback = createReadbackRing(ReductionReadbackSlots, 1, 1, 1, GL_FLOAT, StoreMaxSpeed, nullptr);
+
+	return true;
+}
+
+// Reduces max |u| of velocity to one texel and starts reading it back.
+// Nothing waits on the copy; ReadMaxVelocity picks it up later.
+void RequestMaxVelocity(Surface velocity)
+{
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	ReduceSurface(chain, velocity, ReductionMaxMagnitude, maxSpeedSurface);
+	QueueReadback(readback, maxSpeedSurface, 0);
+
+	ResetState();
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+// Stores the newest max |u| whose copy has completed. Returns false, leaving
+// maxSpeed untouched, if none has completed since the last call.
+bool ReadMaxVelocity(float* maxSpeed)
+{
+	if (!PollReadbacks(readback))
+		return false;
+	*maxSpeed = latestMaxSpeed;
+	return true;
+}
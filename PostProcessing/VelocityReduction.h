@@ -0,0 +1,11 @@
+#pragma once
+#include "stdafx.h"
+#include "FluidSimulation.h"
+#include "Shader.h"
+
+// Readbacks in flight; a result is normally consumed one frame after it is requested.
+#define ReductionReadbackSlots (3)
+
+bool createVelocityReduction(int width, int height);
+void RequestMaxVelocity(Surface velocity);
+bool ReadMaxVelocity(float* maxSpeed);
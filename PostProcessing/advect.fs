@@ -8,19 +8,24 @@ uniform sampler2D Obstacles;
 
 uniform vec2 InverseSize;
 uniform float TimeStep;
+uniform float VelocityScale;
 uniform float Dissipation;
+// Destination cells per obstacle cell; 1 when advecting velocity.
+uniform int DensityScale;
+// Written to solid cells: the velocity boundary value, or zero for scalars.
+uniform vec4 SolidValue;
 
 void main()
 {
     vec2 fragCoord = gl_FragCoord.xy;
-    float solid = texture(Obstacles, InverseSize * fragCoord).x;
+    float solid = texelFetch(Obstacles, ivec2(fragCoord) / DensityScale, 0).x;
     if (solid > 0) {
-        FragColor = vec4(0.0, 1.0, 0.0, 0.0);
+        FragColor = SolidValue;
         return;
     }
 
     vec2 u = texture(VelocityTexture, InverseSize * fragCoord).xy;
-    vec2 coord = InverseSize * (fragCoord - TimeStep * u);
+    vec2 coord = InverseSize * (fragCoord - TimeStep * VelocityScale * u);
 
     FragColor = Dissipation * texture(SourceTexture, coord);
 }
\ No newline at end of file
@@ -0,0 +1,33 @@
+#version 330 core
+
+layout(location = 0) out vec4 VelocityOut;
+layout(location = 1) out vec4 DensityOut;
+
+uniform sampler2D VelocityTexture;
+uniform sampler2D DensityTexture;
+uniform sampler2D Obstacles;
+
+uniform vec2 InverseSize;
+uniform float TimeStep;
+uniform float VelocityDissipation;
+uniform float DensityDissipation;
+
+void main()
+{
+    vec2 fragCoord = gl_FragCoord.xy;
+    float solid = texture(Obstacles, InverseSize * fragCoord).x;
+    if (solid > 0) {
+        VelocityOut = vec4(0.0, 1.0, 0.0, 0.0);
+        DensityOut = vec4(0.0);
+        return;
+    }
+
+    vec2 u = texture(VelocityTexture, InverseSize * fragCoord).xy;
+    vec2 coord = InverseSize * (fragCoord - TimeStep * u);
+    vec4 advected = VelocityDissipation * texture(VelocityTexture, coord);
+    VelocityOut = advected;
+
+    // Density follows the advected velocity of this cell, as in the separate passes:
+    vec2 densityCoord = InverseSize * (fragCoord - TimeStep * advected.xy);
+    DensityOut = DensityDissipation * texture(DensityTexture, densityCoord);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+
+layout(location = 0) out vec4 Out0;
+layout(location = 1) out vec4 Out1;
+layout(location = 2) out vec4 Out2;
+layout(location = 3) out vec4 Out3;
+
+uniform sampler2D VelocityTexture;
+uniform sampler2D Obstacles;
+uniform sampler2D Slab0;
+uniform sampler2D Slab1;
+uniform sampler2D Slab2;
+uniform sampler2D Slab3;
+
+uniform vec2 InverseSize;
+uniform float TimeStep;
+uniform float VelocityScale;
+uniform float Dissipation;
+// Destination cells per obstacle cell; 1 when advecting velocity.
+uniform int DensityScale;
+uniform int NumSlabs;
+
+// advect.fs for up to four RGBA slabs of passive scalars sharing one back-trace.
+void main()
+{
+    vec2 fragCoord = gl_FragCoord.xy;
+    float solid = texelFetch(Obstacles, ivec2(fragCoord) / DensityScale, 0).x;
+    if (solid > 0) {
+        Out0 = Out1 = Out2 = Out3 = vec4(0.0);
+        return;
+    }
+
+    vec2 u = texture(VelocityTexture, InverseSize * fragCoord).xy;
+    vec2 coord = InverseSize * (fragCoord - TimeStep * VelocityScale * u);
+
+    Out0 = Dissipation * texture(Slab0, coord);
+    Out1 = (NumSlabs > 1) ? Dissipation * texture(Slab1, coord) : vec4(0.0);
+    Out2 = (NumSlabs > 2) ? Dissipation * texture(Slab2, coord) : vec4(0.0);
+    Out3 = (NumSlabs > 3) ? Dissipation * texture(Slab3, coord) : vec4(0.0);
+}
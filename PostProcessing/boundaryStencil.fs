@@ -0,0 +1,16 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform usampler2D ObstacleMask;
+uniform uint Bits;
+
+// Keeps only cells whose obstacle mask has any of Bits set; the stencil op marks them.
+void main()
+{
+    uint m = texelFetch(ObstacleMask, ivec2(gl_FragCoord.xy), 0).r;
+    if ((m & Bits) == 0u)
+        discard;
+
+    FragColor = vec4(0.0);
+}
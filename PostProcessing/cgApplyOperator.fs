@@ -0,0 +1,34 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D Direction;
+uniform usampler2D ObstacleMask;
+uniform float InverseCellSizeSquared;
+uniform int Initialize;
+uniform sampler2D Divergence;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    if ((m & 1u) != 0u) {
+        FragColor = 0.0;
+        return;
+    }
+
+    // Find neighboring values, using the center value for solid cells as in jacobi.fs:
+    float pC = texelFetch(Direction, T, 0).r;
+    float pN = ((m & 2u) != 0u) ? pC : texelFetchOffset(Direction, T, 0, ivec2(0, 1)).r;
+    float pS = ((m & 4u) != 0u) ? pC : texelFetchOffset(Direction, T, 0, ivec2(0, -1)).r;
+    float pE = ((m & 8u) != 0u) ? pC : texelFetchOffset(Direction, T, 0, ivec2(1, 0)).r;
+    float pW = ((m & 16u) != 0u) ? pC : texelFetchOffset(Direction, T, 0, ivec2(-1, 0)).r;
+
+    // A = -Laplacian, which is positive semi-definite. The initial residual is -b - Ax.
+    float Ap = (4.0 * pC - pW - pE - pS - pN) * InverseCellSizeSquared;
+    if (Initialize != 0)
+        FragColor = -texelFetch(Divergence, T, 0).r - Ap;
+    else
+        FragColor = Ap;
+}
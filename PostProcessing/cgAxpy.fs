@@ -0,0 +1,25 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D X;
+uniform sampler2D P;
+uniform sampler2D Numerator;
+uniform sampler2D Denominator;
+uniform sampler2D InitialNorm;
+uniform float Sign;
+uniform float ToleranceSquared;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // alpha = (r.z) / (p.Ap), read from the 1x1 reduction results. Once the
+    // residual is below tolerance the step freezes, so extra iterations are no-ops.
+    float rz = texelFetch(Numerator, ivec2(0), 0).r;
+    float pAp = texelFetch(Denominator, ivec2(0), 0).r;
+    float rz0 = texelFetch(InitialNorm, ivec2(0), 0).r;
+    float alpha = (pAp > 0.0 && rz > ToleranceSquared * rz0) ? rz / pAp : 0.0;
+
+    FragColor = texelFetch(X, T, 0).r + Sign * alpha * texelFetch(P, T, 0).r;
+}
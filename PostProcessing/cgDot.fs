@@ -0,0 +1,28 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D A;
+uniform sampler2D B;
+uniform sampler2D InverseDiagonal;
+uniform ivec2 SourceSize;
+uniform int Precondition;
+
+void main()
+{
+    // First level of the reduction, fused with the products; covers a 4x4 block.
+    ivec2 base = 4 * ivec2(gl_FragCoord.xy);
+    float sum = 0.0;
+
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            ivec2 T = base + ivec2(i, j);
+            if (any(greaterThanEqual(T, SourceSize)))
+                continue;
+            float w = (Precondition != 0) ? texelFetch(InverseDiagonal, T, 0).r : 1.0;
+            sum += texelFetch(A, T, 0).r * texelFetch(B, T, 0).r * w;
+        }
+    }
+
+    FragColor = sum;
+}
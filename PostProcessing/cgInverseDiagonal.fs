@@ -0,0 +1,27 @@
+#version 150 core
+
+out float FragColor;
+
+uniform usampler2D ObstacleMask;
+uniform float CellSizeSquared;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Solid cells are excluded from the system:
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    if ((m & 1u) != 0u) {
+        FragColor = 0.0;
+        return;
+    }
+
+    // Solid neighbors reuse the center pressure, so only fluid neighbors add to the diagonal:
+    float fluid = 0.0;
+    if ((m & 2u) == 0u) fluid += 1.0;
+    if ((m & 4u) == 0u) fluid += 1.0;
+    if ((m & 8u) == 0u) fluid += 1.0;
+    if ((m & 16u) == 0u) fluid += 1.0;
+
+    FragColor = (fluid > 0.0) ? CellSizeSquared / fluid : 0.0;
+}
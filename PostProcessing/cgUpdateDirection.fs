@@ -0,0 +1,26 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D Residual;
+uniform sampler2D Direction;
+uniform sampler2D InverseDiagonal;
+uniform sampler2D RzNew;
+uniform sampler2D RzOld;
+uniform int Restart;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Diagonal preconditioner: z = r / diag(A).
+    float z = texelFetch(Residual, T, 0).r * texelFetch(InverseDiagonal, T, 0).r;
+    if (Restart != 0) {
+        FragColor = z;
+        return;
+    }
+
+    float rzOld = texelFetch(RzOld, ivec2(0), 0).r;
+    float beta = (rzOld > 0.0) ? texelFetch(RzNew, ivec2(0), 0).r / rzOld : 0.0;
+    FragColor = z + beta * texelFetch(Direction, T, 0).r;
+}
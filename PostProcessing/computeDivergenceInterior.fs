@@ -0,0 +1,19 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D Velocity;
+uniform float HalfInverseCellSize;
+
+// Branch-free computeDivergence.fs for cells with no solid neighbors.
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    vec2 vN = texelFetchOffset(Velocity, T, 0, ivec2(0, 1)).xy;
+    vec2 vS = texelFetchOffset(Velocity, T, 0, ivec2(0, -1)).xy;
+    vec2 vE = texelFetchOffset(Velocity, T, 0, ivec2(1, 0)).xy;
+    vec2 vW = texelFetchOffset(Velocity, T, 0, ivec2(-1, 0)).xy;
+
+    FragColor = HalfInverseCellSize * (vE.x - vW.x + vN.y - vS.y);
+}
@@ -0,0 +1,14 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Current;
+uniform sampler2D Previous;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Linear extrapolation in time of the last two pressure solutions:
+    FragColor = 2.0 * texelFetch(Current, T, 0) - texelFetch(Previous, T, 0);
+}
@@ -0,0 +1,38 @@
+#version 330 core
+
+layout(location = 0) out vec4 VelocityOut;
+layout(location = 1) out float DivergenceOut;
+
+uniform sampler2D Velocity;
+uniform usampler2D ObstacleMask;
+uniform vec2 InverseSize;
+uniform float ForceScale;
+uniform float HalfInverseCellSize;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+    vec2 fragCoord = gl_FragCoord.xy;
+
+    // Divergence of the velocity before the force, as in computeDivergence.fs:
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    vec2 vN = ((m & 2u) != 0u) ? vec2(0) : texelFetchOffset(Velocity, T, 0, ivec2(0, 1)).xy;
+    vec2 vS = ((m & 4u) != 0u) ? vec2(0) : texelFetchOffset(Velocity, T, 0, ivec2(0, -1)).xy;
+    vec2 vE = ((m & 8u) != 0u) ? vec2(0) : texelFetchOffset(Velocity, T, 0, ivec2(1, 0)).xy;
+    vec2 vW = ((m & 16u) != 0u) ? vec2(0) : texelFetchOffset(Velocity, T, 0, ivec2(-1, 0)).xy;
+
+    DivergenceOut = HalfInverseCellSize * (vE.x - vW.x + vN.y - vS.y);
+
+    // Force, as in gravityField.fs:
+    vec2 uv = InverseSize * fragCoord;
+    vec2 u = texture(Velocity, uv).xy;
+
+    if (uv.x > 0.5 && uv.x < 0.5625 && uv.y > 5.0 / 6.0)
+    {
+        VelocityOut = vec4(u + ForceScale * vec2(0.0, 100.1), 0, 0);
+    }
+    else
+    {
+        VelocityOut = vec4(u - ForceScale * vec2(0.0, 5.1), 0.0, 0.0);
+    }
+}
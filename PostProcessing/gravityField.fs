@@ -3,19 +3,21 @@
 out vec4 FragColor;
 uniform sampler2D VelocityTexture;
 uniform vec2 InverseSize;
+uniform float ForceScale;
 
 void main()
 {
 	vec2 fragCoord = gl_FragCoord.xy;
 
-	vec2 u = texture(VelocityTexture, fragCoord).xy;
+	vec2 uv = InverseSize * fragCoord;
+	vec2 u = texture(VelocityTexture, uv).xy;
 
-	if (fragCoord.x > 400 && fragCoord.x < 450 && fragCoord.y > 500)
+	if (uv.x > 0.5 && uv.x < 0.5625 && uv.y > 5.0 / 6.0)
 	{
-		FragColor = vec4(u + vec2(0.0, 100.1), 0, 0);
+		FragColor = vec4(u + ForceScale * vec2(0.0, 100.1), 0, 0);
 	}
 	else
 	{
-	    FragColor = vec4(u - vec2(0.0, 5.1), 0.0, 0.0);
+	    FragColor = vec4(u - ForceScale * vec2(0.0, 5.1), 0.0, 0.0);
 	}
 }
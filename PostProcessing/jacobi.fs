@@ -4,34 +4,27 @@ out vec4 FragColor;
 
 uniform sampler2D Pressure;
 uniform sampler2D Divergence;
-uniform sampler2D Obstacles;
+uniform usampler2D ObstacleMask;
 
 uniform float Alpha;
 uniform float InverseBeta;
+uniform float Omega;
 
 void main()
 {
     ivec2 T = ivec2(gl_FragCoord.xy);
 
-    // Find neighboring pressure:
-    vec4 pN = texelFetchOffset(Pressure, T, 0, ivec2(0, 1));
-    vec4 pS = texelFetchOffset(Pressure, T, 0, ivec2(0, -1));
-    vec4 pE = texelFetchOffset(Pressure, T, 0, ivec2(1, 0));
-    vec4 pW = texelFetchOffset(Pressure, T, 0, ivec2(-1, 0));
+    // One fetch gives the solid flags of all four neighbors:
+    uint m = texelFetch(ObstacleMask, T, 0).r;
     vec4 pC = texelFetch(Pressure, T, 0);
 
-    // Find neighboring obstacles:
-    vec3 oN = texelFetchOffset(Obstacles, T, 0, ivec2(0, 1)).xyz;
-    vec3 oS = texelFetchOffset(Obstacles, T, 0, ivec2(0, -1)).xyz;
-    vec3 oE = texelFetchOffset(Obstacles, T, 0, ivec2(1, 0)).xyz;
-    vec3 oW = texelFetchOffset(Obstacles, T, 0, ivec2(-1, 0)).xyz;
-
-    // Use center pressure for solid cells:
-    if (oN.x > 0) pN = pC;
-    if (oS.x > 0) pS = pC;
-    if (oE.x > 0) pE = pC;
-    if (oW.x > 0) pW = pC;
+    // Find neighboring pressure, using center pressure for solid cells:
+    vec4 pN = ((m & 2u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, 1));
+    vec4 pS = ((m & 4u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, -1));
+    vec4 pE = ((m & 8u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(1, 0));
+    vec4 pW = ((m & 16u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(-1, 0));
 
+    // Weighted Jacobi; Omega = 1 is the plain update:
     vec4 bC = texelFetch(Divergence, T, 0);
-    FragColor = (pW + pE + pS + pN + Alpha * bC) * InverseBeta;
-}
\ No newline at end of file
+    FragColor = mix(pC, (pW + pE + pS + pN + Alpha * bC) * InverseBeta, Omega);
+}
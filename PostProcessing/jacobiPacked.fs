@@ -0,0 +1,39 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Pressure;
+uniform sampler2D Divergence;
+uniform usampler2D ObstacleMask;
+
+uniform float Alpha;
+uniform float InverseBeta;
+uniform float Omega;
+
+// jacobi.fs on the packed 2x2 layout (r g in the bottom row, b a in the top row).
+// Five pressure fetches cover the neighbors of all four cells.
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    uvec4 m = texelFetch(ObstacleMask, T, 0);
+    vec4 C = texelFetch(Pressure, T, 0);
+    vec4 N = texelFetchOffset(Pressure, T, 0, ivec2(0, 1));
+    vec4 S = texelFetchOffset(Pressure, T, 0, ivec2(0, -1));
+    vec4 E = texelFetchOffset(Pressure, T, 0, ivec2(1, 0));
+    vec4 W = texelFetchOffset(Pressure, T, 0, ivec2(-1, 0));
+
+    vec4 pN = vec4(C.b, C.a, N.r, N.g);
+    vec4 pS = vec4(S.b, S.a, C.r, C.g);
+    vec4 pE = vec4(C.g, E.r, C.a, E.b);
+    vec4 pW = vec4(W.g, C.r, W.a, C.b);
+
+    // Use center pressure for solid neighbors:
+    pN = mix(pN, C, notEqual(m & 2u, uvec4(0u)));
+    pS = mix(pS, C, notEqual(m & 4u, uvec4(0u)));
+    pE = mix(pE, C, notEqual(m & 8u, uvec4(0u)));
+    pW = mix(pW, C, notEqual(m & 16u, uvec4(0u)));
+
+    vec4 bC = texelFetch(Divergence, T, 0);
+    FragColor = mix(C, (pW + pE + pS + pN + Alpha * bC) * InverseBeta, Omega);
+}
@@ -0,0 +1,58 @@
+#version 330 core
+
+layout(location = 0) out vec2 VelocityOut;
+layout(location = 1) out vec4 PressureOut;
+
+uniform sampler2D Velocity;
+uniform sampler2D Pressure;
+uniform sampler2D Divergence;
+uniform usampler2D ObstacleMask;
+
+uniform float Alpha;
+uniform float InverseBeta;
+uniform float GradientScale;
+
+// One jacobi.fs update evaluated at T:
+float JacobiAt(ivec2 T)
+{
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    float pC = texelFetch(Pressure, T, 0).r;
+    float pN = ((m & 2u) != 0u) ? pC : texelFetch(Pressure, T + ivec2(0, 1), 0).r;
+    float pS = ((m & 4u) != 0u) ? pC : texelFetch(Pressure, T + ivec2(0, -1), 0).r;
+    float pE = ((m & 8u) != 0u) ? pC : texelFetch(Pressure, T + ivec2(1, 0), 0).r;
+    float pW = ((m & 16u) != 0u) ? pC : texelFetch(Pressure, T + ivec2(-1, 0), 0).r;
+    float bC = texelFetch(Divergence, T, 0).r;
+    return (pW + pE + pS + pN + Alpha * bC) * InverseBeta;
+}
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+
+    // The last pressure iteration, kept for the next frame's warm start:
+    float pC = JacobiAt(T);
+    PressureOut = vec4(pC, 0.0, 0.0, 0.0);
+
+    if ((m & 1u) != 0u) {
+        VelocityOut = vec2(0);
+        return;
+    }
+
+    // Neighboring pressure after the same iteration; solid neighbors are never relaxed here:
+    float pN = ((m & 2u) != 0u) ? pC : JacobiAt(T + ivec2(0, 1));
+    float pS = ((m & 4u) != 0u) ? pC : JacobiAt(T + ivec2(0, -1));
+    float pE = ((m & 8u) != 0u) ? pC : JacobiAt(T + ivec2(1, 0));
+    float pW = ((m & 16u) != 0u) ? pC : JacobiAt(T + ivec2(-1, 0));
+
+    // Same boundary handling as subtractGradient.fs:
+    vec2 vMask = vec2(1);
+
+    if ((m & 6u) != 0u) vMask.y = 0;
+    if ((m & 24u) != 0u) vMask.x = 0;
+
+    vec2 oldV = texelFetch(Velocity, T, 0).xy;
+    vec2 grad = vec2(pE - pW, pN - pS) * GradientScale;
+    vec2 newV = oldV - grad;
+    VelocityOut = vMask * newV;
+}
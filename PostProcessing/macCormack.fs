@@ -0,0 +1,47 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D VelocityTexture;
+uniform sampler2D Source;
+uniform sampler2D Forward;
+uniform sampler2D Backward;
+uniform sampler2D Obstacles;
+
+uniform vec2 InverseSize;
+uniform float TimeStep;
+uniform float VelocityScale;
+uniform float Dissipation;
+// Destination cells per obstacle cell; 1 when advecting velocity.
+uniform int DensityScale;
+// Written to solid cells: the velocity boundary value, or zero for scalars.
+uniform vec4 SolidValue;
+
+void main()
+{
+    vec2 fragCoord = gl_FragCoord.xy;
+    float solid = texelFetch(Obstacles, ivec2(fragCoord) / DensityScale, 0).x;
+    if (solid > 0) {
+        FragColor = SolidValue;
+        return;
+    }
+
+    ivec2 T = ivec2(fragCoord);
+    vec4 corrected = texelFetch(Forward, T, 0) + 0.5 * (texelFetch(Source, T, 0) - texelFetch(Backward, T, 0));
+
+    // Limit to the four source cells the forward step interpolated between:
+    vec2 u = texture(VelocityTexture, InverseSize * fragCoord).xy;
+    vec2 p = fragCoord - TimeStep * VelocityScale * u - 0.5;
+    ivec2 M = textureSize(Source, 0) - 1;
+    ivec2 B = ivec2(floor(p));
+
+    vec4 s00 = texelFetch(Source, clamp(B, ivec2(0), M), 0);
+    vec4 s10 = texelFetch(Source, clamp(B + ivec2(1, 0), ivec2(0), M), 0);
+    vec4 s01 = texelFetch(Source, clamp(B + ivec2(0, 1), ivec2(0), M), 0);
+    vec4 s11 = texelFetch(Source, clamp(B + ivec2(1, 1), ivec2(0), M), 0);
+
+    vec4 lo = min(min(s00, s10), min(s01, s11));
+    vec4 hi = max(max(s00, s10), max(s01, s11));
+
+    FragColor = Dissipation * clamp(corrected, lo, hi);
+}
@@ -0,0 +1,21 @@
+#version 150 core
+
+out uint FragColor;
+
+uniform sampler2D Obstacles;
+
+// Bit layout shared by the stencil shaders:
+// 1 = center, 2 = north, 4 = south, 8 = east, 16 = west are solid.
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+    uint mask = 0u;
+
+    if (texelFetch(Obstacles, T, 0).x > 0) mask |= 1u;
+    if (texelFetchOffset(Obstacles, T, 0, ivec2(0, 1)).x > 0) mask |= 2u;
+    if (texelFetchOffset(Obstacles, T, 0, ivec2(0, -1)).x > 0) mask |= 4u;
+    if (texelFetchOffset(Obstacles, T, 0, ivec2(1, 0)).x > 0) mask |= 8u;
+    if (texelFetchOffset(Obstacles, T, 0, ivec2(-1, 0)).x > 0) mask |= 16u;
+
+    FragColor = mask;
+}
@@ -0,0 +1,15 @@
+#version 150 core
+
+out uvec4 FragColor;
+
+uniform usampler2D ObstacleMask;
+
+void main()
+{
+    ivec2 T = 2 * ivec2(gl_FragCoord.xy);
+
+    FragColor = uvec4(texelFetch(ObstacleMask, T, 0).r,
+                      texelFetchOffset(ObstacleMask, T, 0, ivec2(1, 0)).r,
+                      texelFetchOffset(ObstacleMask, T, 0, ivec2(0, 1)).r,
+                      texelFetchOffset(ObstacleMask, T, 0, ivec2(1, 1)).r);
+}
@@ -0,0 +1,16 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Source;
+
+// Gathers the .r of a 2x2 block of cells into one texel.
+void main()
+{
+    ivec2 T = 2 * ivec2(gl_FragCoord.xy);
+
+    FragColor = vec4(texelFetch(Source, T, 0).r,
+                     texelFetchOffset(Source, T, 0, ivec2(1, 0)).r,
+                     texelFetchOffset(Source, T, 0, ivec2(0, 1)).r,
+                     texelFetchOffset(Source, T, 0, ivec2(1, 1)).r);
+}
@@ -0,0 +1,18 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Pressure;
+uniform sampler2D Correction;
+uniform vec2 CoarseInverseSize;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Bilinear interpolation of the coarse correction comes from the sampler:
+    vec4 pC = texelFetch(Pressure, T, 0);
+    float e = texture(Correction, gl_FragCoord.xy * CoarseInverseSize).r;
+
+    FragColor = pC + vec4(e, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,35 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Pressure;
+uniform sampler2D Divergence;
+uniform usampler2D ObstacleMask;
+
+uniform float Alpha;
+uniform float InverseBeta;
+uniform float Omega;
+uniform int Parity;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Only cells of the current color are written; the others keep their value in place:
+    if (((T.x + T.y) & 1) != Parity)
+        discard;
+
+    // One fetch gives the solid flags of all four neighbors:
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    vec4 pC = texelFetch(Pressure, T, 0);
+
+    // Find neighboring pressure (all of the other color), using center pressure for solid cells:
+    vec4 pN = ((m & 2u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, 1));
+    vec4 pS = ((m & 4u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, -1));
+    vec4 pE = ((m & 8u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(1, 0));
+    vec4 pW = ((m & 16u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(-1, 0));
+
+    // Over-relaxed Gauss-Seidel update:
+    vec4 bC = texelFetch(Divergence, T, 0);
+    FragColor = mix(pC, (pW + pE + pS + pN + Alpha * bC) * InverseBeta, Omega);
+}
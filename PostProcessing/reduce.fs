@@ -0,0 +1,33 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D Source;
+uniform ivec2 SourceSize;
+uniform int Operation;
+
+void main()
+{
+    // Each output texel covers a 4x4 block of the source; texels past the edge are skipped.
+    ivec2 base = 4 * ivec2(gl_FragCoord.xy);
+    // Operation: 0 = sum, 1 = max, 2 = sum of squares, 3 = max of |xy|.
+    float result = (Operation == 1) ? -3.4e38 : 0.0;
+
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            ivec2 T = base + ivec2(i, j);
+            if (any(greaterThanEqual(T, SourceSize)))
+                continue;
+            vec4 s = texelFetch(Source, T, 0);
+            float v = s.r;
+            if (Operation == 1)
+                result = max(result, v);
+            else if (Operation == 3)
+                result = max(result, length(s.xy));
+            else
+                result += (Operation == 2) ? v * v : v;
+        }
+    }
+
+    FragColor = result;
+}
@@ -0,0 +1,32 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Pressure;
+uniform sampler2D Divergence;
+uniform usampler2D ObstacleMask;
+
+uniform float InverseCellSizeSquared;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    // Solid cells carry no residual:
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+    if ((m & 1u) != 0u) {
+        FragColor = vec4(0.0);
+        return;
+    }
+
+    // Find neighboring pressure, using center pressure for solid cells:
+    float pC = texelFetch(Pressure, T, 0).r;
+    float pN = ((m & 2u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, 1)).r;
+    float pS = ((m & 4u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(0, -1)).r;
+    float pE = ((m & 8u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(1, 0)).r;
+    float pW = ((m & 16u) != 0u) ? pC : texelFetchOffset(Pressure, T, 0, ivec2(-1, 0)).r;
+
+    // r = b - Ap, with the same operator jacobi.fs relaxes:
+    float bC = texelFetch(Divergence, T, 0).r;
+    FragColor = vec4(bC - (pW + pE + pS + pN - 4.0 * pC) * InverseCellSizeSquared, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,20 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Source;
+uniform ivec2 SourceSize;
+
+void main()
+{
+    // Each coarse cell averages its 2x2 fine children; odd edges are clamped.
+    ivec2 T = 2 * ivec2(gl_FragCoord.xy);
+    ivec2 M = SourceSize - 1;
+
+    float r00 = texelFetch(Source, min(T, M), 0).r;
+    float r10 = texelFetch(Source, min(T + ivec2(1, 0), M), 0).r;
+    float r01 = texelFetch(Source, min(T + ivec2(0, 1), M), 0).r;
+    float r11 = texelFetch(Source, min(T + ivec2(1, 1), M), 0).r;
+
+    FragColor = vec4(0.25 * (r00 + r10 + r01 + r11), 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,21 @@
+#version 150 core
+
+out vec3 FragColor;
+
+uniform sampler2D Obstacles;
+uniform ivec2 SourceSize;
+
+void main()
+{
+    // A coarse cell is solid if any of its 2x2 fine children is solid,
+    // which keeps the one-cell border intact on every level.
+    ivec2 T = 2 * ivec2(gl_FragCoord.xy);
+    ivec2 M = SourceSize - 1;
+
+    float o00 = texelFetch(Obstacles, min(T, M), 0).x;
+    float o10 = texelFetch(Obstacles, min(T + ivec2(1, 0), M), 0).x;
+    float o01 = texelFetch(Obstacles, min(T + ivec2(0, 1), M), 0).x;
+    float o11 = texelFetch(Obstacles, min(T + ivec2(1, 1), M), 0).x;
+
+    FragColor = vec3(max(max(o00, o10), max(o01, o11)), 0.0, 0.0);
+}
@@ -0,0 +1,20 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Source;
+uniform ivec2 SourceSize;
+
+void main()
+{
+    // restrict.fs for two-component fields.
+    ivec2 T = 2 * ivec2(gl_FragCoord.xy);
+    ivec2 M = SourceSize - 1;
+
+    vec2 v00 = texelFetch(Source, min(T, M), 0).xy;
+    vec2 v10 = texelFetch(Source, min(T + ivec2(1, 0), M), 0).xy;
+    vec2 v01 = texelFetch(Source, min(T + ivec2(0, 1), M), 0).xy;
+    vec2 v11 = texelFetch(Source, min(T + ivec2(1, 1), M), 0).xy;
+
+    FragColor = vec4(0.25 * (v00 + v10 + v01 + v11), 0.0, 0.0);
+}
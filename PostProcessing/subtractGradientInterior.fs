@@ -0,0 +1,22 @@
+#version 150 core
+
+out vec2 FragColor;
+
+uniform sampler2D Velocity;
+uniform sampler2D Pressure;
+uniform float GradientScale;
+
+// Branch-free subtractGradient.fs for cells with no solid neighbors.
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+
+    float pN = texelFetchOffset(Pressure, T, 0, ivec2(0, 1)).r;
+    float pS = texelFetchOffset(Pressure, T, 0, ivec2(0, -1)).r;
+    float pE = texelFetchOffset(Pressure, T, 0, ivec2(1, 0)).r;
+    float pW = texelFetchOffset(Pressure, T, 0, ivec2(-1, 0)).r;
+
+    vec2 oldV = texelFetch(Velocity, T, 0).xy;
+    vec2 grad = vec2(pE - pW, pN - pS) * GradientScale;
+    FragColor = oldV - grad;
+}
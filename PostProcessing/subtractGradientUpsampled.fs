@@ -0,0 +1,40 @@
+#version 150 core
+
+out vec2 FragColor;
+
+uniform sampler2D Velocity;
+uniform sampler2D Pressure;
+uniform usampler2D ObstacleMask;
+uniform vec2 InverseSize;
+uniform float GradientScale;
+
+// subtractGradient.fs with Pressure on a coarser grid, sampled bilinearly one fine cell
+// to either side.
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+    uint m = texelFetch(ObstacleMask, T, 0).r;
+
+    if ((m & 1u) != 0u) {
+        FragColor = vec2(0);
+        return;
+    }
+
+    vec2 uv = InverseSize * gl_FragCoord.xy;
+    float pN = texture(Pressure, uv + vec2(0.0, InverseSize.y)).r;
+    float pS = texture(Pressure, uv - vec2(0.0, InverseSize.y)).r;
+    float pE = texture(Pressure, uv + vec2(InverseSize.x, 0.0)).r;
+    float pW = texture(Pressure, uv - vec2(InverseSize.x, 0.0)).r;
+    float pC = texture(Pressure, uv).r;
+
+    vec2 vMask = vec2(1);
+
+    if ((m & 2u) != 0u) { pN = pC; vMask.y = 0; }
+    if ((m & 4u) != 0u) { pS = pC; vMask.y = 0; }
+    if ((m & 8u) != 0u) { pE = pC; vMask.x = 0; }
+    if ((m & 16u) != 0u) { pW = pC; vMask.x = 0; }
+
+    vec2 oldV = texelFetch(Velocity, T, 0).xy;
+    vec2 grad = vec2(pE - pW, pN - pS) * GradientScale;
+    FragColor = vMask * (oldV - grad);
+}
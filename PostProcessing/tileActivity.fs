@@ -0,0 +1,35 @@
+#version 150 core
+
+out float FragColor;
+
+uniform sampler2D Velocity;
+uniform sampler2D Density;
+
+uniform int TileSize;
+uniform int DensityScale;
+uniform ivec2 GridSize;
+uniform float Threshold;
+uniform ivec4 SourceRegion;
+
+// One fragment per tile: 1 if any of its cells moves or holds density, or it overlaps the force source.
+// A finer density grid is sampled once per cell.
+void main()
+{
+    ivec2 origin = ivec2(gl_FragCoord.xy) * TileSize;
+    ivec2 end = min(origin + TileSize, GridSize);
+
+    if (all(lessThan(origin, SourceRegion.zw)) && all(greaterThan(end, SourceRegion.xy))) {
+        FragColor = 1.0;
+        return;
+    }
+
+    float m = 0.0;
+    for (int y = origin.y; y < end.y; y++) {
+        for (int x = origin.x; x < end.x; x++) {
+            ivec2 T = ivec2(x, y);
+            m = max(m, max(length(texelFetch(Velocity, T, 0).xy), abs(texelFetch(Density, T * DensityScale + DensityScale / 2, 0).x)));
+        }
+    }
+
+    FragColor = (m > Threshold) ? 1.0 : 0.0;
+}
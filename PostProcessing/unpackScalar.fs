@@ -0,0 +1,13 @@
+#version 150 core
+
+out vec4 FragColor;
+
+uniform sampler2D Packed;
+
+void main()
+{
+    ivec2 T = ivec2(gl_FragCoord.xy);
+    vec4 block = texelFetch(Packed, T / 2, 0);
+
+    FragColor = vec4(block[(T.x & 1) + 2 * (T.y & 1)], 0.0, 0.0, 0.0);
+}
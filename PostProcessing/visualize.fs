@@ -3,11 +3,46 @@
 in vec2 UV;
 out vec4 FragColor;
 uniform sampler2D Sampler;
+uniform sampler2D PreviousSampler;
+uniform float Alpha;
 uniform vec3 FillColor;
 uniform vec2 Scale;
+uniform vec2 SourceSize;
+uniform bool Bicubic;
+// Channel of the slab to show in grey, or -1 for all of them.
+uniform int Channel;
+
+// Cubic B-spline filter from four bilinear taps.
+vec4 textureBicubic(sampler2D Sampler, vec2 uv)
+{
+    vec2 p = uv * SourceSize - 0.5;
+    vec2 f = fract(p);
+    p -= f;
+
+    vec2 f2 = f * f;
+    vec2 f3 = f2 * f;
+    vec2 w0 = (1.0 - 3.0 * f + 3.0 * f2 - f3) / 6.0;
+    vec2 w1 = (4.0 - 6.0 * f2 + 3.0 * f3) / 6.0;
+    vec2 w2 = (1.0 + 3.0 * f + 3.0 * f2 - 3.0 * f3) / 6.0;
+    vec2 w3 = f3 / 6.0;
+
+    vec2 s0 = w0 + w1;
+    vec2 s1 = w2 + w3;
+    vec2 c0 = (p - 0.5 + w1 / s0) / SourceSize;
+    vec2 c1 = (p + 1.5 + w3 / s1) / SourceSize;
+
+    return mix(mix(texture(Sampler, vec2(c0.x, c0.y)), texture(Sampler, vec2(c1.x, c0.y)), s1.x / (s0.x + s1.x)),
+               mix(texture(Sampler, vec2(c0.x, c1.y)), texture(Sampler, vec2(c1.x, c1.y)), s1.x / (s0.x + s1.x)),
+               s1.y / (s0.y + s1.y));
+}
 
 void main()
 {
-    vec4 t = texture(Sampler, gl_FragCoord.xy * Scale);
-    FragColor = abs(t);
+    vec2 uv = gl_FragCoord.xy * Scale;
+    vec4 current = Bicubic ? textureBicubic(Sampler, uv) : texture(Sampler, uv);
+    vec4 previous = Bicubic ? textureBicubic(PreviousSampler, uv) : texture(PreviousSampler, uv);
+
+    // Blend between the last two ticks by how far the frame is past the earlier one.
+    vec4 t = mix(previous, current, Alpha);
+    FragColor = (Channel < 0) ? abs(t) : vec4(vec3(abs(t[Channel])), 1.0);
 }